@@ -0,0 +1,135 @@
+#include "alloc_tracker.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <dlfcn.h>
+#include <new>
+
+namespace {
+
+constexpr int MAX_SITES = 512;
+constexpr int TAG_BITS = 4;
+
+// Open-addressed, insert-only table shared by all threads. A slot is claimed
+// by CAS on its key, so recording never takes a lock nor allocates.
+struct Site {
+	std::atomic<std::uintptr_t> key{0};
+	std::atomic<std::size_t> calls{0};
+	std::atomic<std::size_t> bytes{0};
+};
+
+Site sites[MAX_SITES];
+thread_local alloc_tracker::Counts counts;
+thread_local int current_tag = 0;
+
+void record(void *site, std::size_t size) {
+	counts.calls += 1;
+	counts.bytes += size;
+
+	const std::uintptr_t key = (reinterpret_cast<std::uintptr_t>(site) << TAG_BITS) | current_tag;
+	const std::size_t hash = (key * 0x9E3779B97F4A7C15ull) >> 32;
+	for (int i = 0; i < MAX_SITES; ++i) {
+		Site &s = sites[(hash + i) % MAX_SITES];
+		std::uintptr_t k = s.key.load(std::memory_order_relaxed);
+		if (k == 0 && s.key.compare_exchange_strong(k, key, std::memory_order_relaxed)) {
+			k = key;
+		}
+		if (k == key) {
+			s.calls.fetch_add(1, std::memory_order_relaxed);
+			s.bytes.fetch_add(size, std::memory_order_relaxed);
+			return;
+		}
+	}
+	// table full, the allocation still shows up in the per-thread counts
+}
+
+void *allocate(std::size_t size, void *site) {
+	record(site, size);
+	if (size == 0) {
+		size = 1;
+	}
+	for (;;) {
+		if (void *p = std::malloc(size)) {
+			return p;
+		}
+		std::new_handler handler = std::get_new_handler();
+		if (!handler) {
+			throw std::bad_alloc();
+		}
+		handler();
+	}
+}
+
+void *allocate_aligned(std::size_t size, std::align_val_t align, void *site) {
+	record(site, size);
+	const std::size_t a = static_cast<std::size_t>(align);
+	const std::size_t rounded = (size + a - 1) / a * a;
+	if (void *p = std::aligned_alloc(a, rounded ? rounded : a)) {
+		return p;
+	}
+	throw std::bad_alloc();
+}
+
+}//~ namespace
+
+alloc_tracker::Counts alloc_tracker::thread_counts() {
+	return counts;
+}
+
+void alloc_tracker::set_tag(int tag) {
+	current_tag = tag & ((1 << TAG_BITS) - 1);
+}
+
+void alloc_tracker::report(const char *const *tag_names, int tag_count) {
+	for (int tag = 0; tag < tag_count; ++tag) {
+		bool header = false;
+		for (const Site &s : sites) {
+			const std::uintptr_t key = s.key.load(std::memory_order_relaxed);
+			if (key == 0 || static_cast<int>(key & ((1 << TAG_BITS) - 1)) != tag) {
+				continue;
+			}
+			if (!header) {
+				std::fprintf(stderr, "allocations in %s:\n", tag_names[tag]);
+				header = true;
+			}
+			// return address - 1 lands inside the call instruction
+			void *site = reinterpret_cast<void *>((key >> TAG_BITS) - 1);
+			const std::size_t calls = s.calls.load(std::memory_order_relaxed);
+			const std::size_t bytes = s.bytes.load(std::memory_order_relaxed);
+			Dl_info info;
+			if (dladdr(site, &info) && info.dli_fname) {
+				std::fprintf(stderr, "  %8zu calls %10zu bytes  %s+0x%zx\n", calls, bytes, info.dli_fname,
+					static_cast<std::size_t>(static_cast<char *>(site) - static_cast<char *>(info.dli_fbase)));
+			} else {
+				std::fprintf(stderr, "  %8zu calls %10zu bytes  %p\n", calls, bytes, site);
+			}
+		}
+	}
+}
+
+void *operator new(std::size_t size) {
+	return allocate(size, __builtin_return_address(0));
+}
+
+void *operator new[](std::size_t size) {
+	return allocate(size, __builtin_return_address(0));
+}
+
+void *operator new(std::size_t size, std::align_val_t align) {
+	return allocate_aligned(size, align, __builtin_return_address(0));
+}
+
+void *operator new[](std::size_t size, std::align_val_t align) {
+	return allocate_aligned(size, align, __builtin_return_address(0));
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete[](void *p) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void *p, std::size_t) noexcept { std::free(p); }
+void operator delete(void *p, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void *p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void *p, std::size_t, std::align_val_t) noexcept { std::free(p); }
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+
+// Heap allocation accounting for debug/bench builds (-DFLAPPY_TRACK_ALLOCS=ON).
+// Global operator new is replaced so every allocation is counted per thread
+// and its call site is remembered under the tag the thread set last. In
+// regular builds everything here is an empty inline and compiles away.
+namespace alloc_tracker {
+
+struct Counts {
+	std::size_t calls = 0;
+	std::size_t bytes = 0;
+};
+
+inline Counts operator-(Counts a, Counts b) {
+	return {a.calls - b.calls, a.bytes - b.bytes};
+}
+
+#ifdef FLAPPY_TRACK_ALLOCS
+inline constexpr bool enabled = true;
+
+// Running totals of the calling thread.
+Counts thread_counts();
+
+// Attributes the following allocations of the calling thread to `tag` (0..15).
+void set_tag(int tag);
+
+// Prints every call site seen so far, grouped by tag, as module+offset pairs
+// that can be fed to addr2line.
+void report(const char *const *tag_names, int tag_count);
+#else
+inline constexpr bool enabled = false;
+
+inline Counts thread_counts() { return {}; }
+inline void set_tag(int) {}
+inline void report(const char *const *, int) {}
+#endif
+
+}//~ alloc_tracker
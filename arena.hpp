@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <sys/mman.h>
+#include <type_traits>
+
+// Anonymous mapping owned by one worker thread. Explicit huge pages are tried
+// first (they need pages reserved in /proc/sys/vm/nr_hugepages), otherwise
+// transparent huge pages are requested. Nothing is touched here, so the pages
+// land on the NUMA node of whichever thread writes them first.
+class PageBlock final {
+private:
+	static constexpr std::size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+	void *base_ = nullptr;
+	std::size_t size_ = 0;
+	bool huge_ = false;
+public:
+	explicit PageBlock(std::size_t size) {
+		size_ = (size + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+#ifdef MAP_HUGETLB
+		base_ = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		huge_ = base_ != MAP_FAILED;
+#endif
+		if (!huge_) {
+			base_ = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if (base_ == MAP_FAILED) {
+				throw std::bad_alloc();
+			}
+#ifdef MADV_HUGEPAGE
+			madvise(base_, size_, MADV_HUGEPAGE);
+#endif
+		}
+	}
+
+	~PageBlock() {
+		munmap(base_, size_);
+	}
+
+	PageBlock(const PageBlock&) = delete;
+	PageBlock& operator=(const PageBlock&) = delete;
+
+	void *data() const { return base_; }
+	std::size_t size() const { return size_; }
+	bool huge_pages() const { return huge_; }
+};
+
+// Bump allocator over memory it does not own. Individual allocations are never
+// freed; reset() releases everything at once by rewinding the pointer.
+class Arena final {
+private:
+	char *begin_ = nullptr;
+	char *cur_ = nullptr;
+	char *end_ = nullptr;
+public:
+	static constexpr std::size_t CACHE_LINE = 64;
+
+	Arena() = default;
+	Arena(void *memory, std::size_t size)
+		: begin_(static_cast<char *>(memory)), cur_(begin_), end_(begin_ + size) {}
+	explicit Arena(const PageBlock &block) : Arena(block.data(), block.size()) {}
+
+	// Returns nullptr once the arena is exhausted.
+	void *allocate(std::size_t size, std::size_t align = alignof(std::max_align_t)) noexcept {
+		const auto p = reinterpret_cast<std::uintptr_t>(cur_);
+		const auto aligned = (p + align - 1) & ~(std::uintptr_t{align} - 1);
+		if (aligned + size > reinterpret_cast<std::uintptr_t>(end_)) {
+			return nullptr;
+		}
+		cur_ = reinterpret_cast<char *>(aligned + size);
+		return reinterpret_cast<void *>(aligned);
+	}
+
+	// Cache-line aligned, value-initialized array for setup-time allocations;
+	// throws when the arena was sized too small.
+	template <typename T>
+	T *make_array(std::size_t count) {
+		static_assert(std::is_trivially_destructible_v<T>, "arena memory is released without running destructors");
+		void *p = allocate(sizeof(T) * count, CACHE_LINE);
+		if (!p) {
+			throw std::bad_alloc();
+		}
+		T *items = static_cast<T *>(p);
+		for (std::size_t i = 0; i < count; ++i) {
+			new (items + i) T{};
+		}
+		return items;
+	}
+
+	// Splits off `size` bytes as an independent arena.
+	Arena carve(std::size_t size) {
+		void *p = allocate(size, CACHE_LINE);
+		if (!p) {
+			throw std::bad_alloc();
+		}
+		return Arena(p, size);
+	}
+
+	void reset() { cur_ = begin_; }
+	std::size_t used() const { return cur_ - begin_; }
+	std::size_t capacity() const { return end_ - begin_; }
+};
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+#include "env.hpp"
+#include "hash.hpp"
+
+// Reference controller: flap once the bird has sunk `offset` pixels below the
+// center of the next gap and is still falling.
+inline void heuristic_bot(const EnvBatch &batch, std::uint8_t *flap, float offset = 40.0f) {
+	const float *y = batch.y();
+	const float *vy = batch.vy();
+	const float *gap = batch.gap();
+	for (int i = 0; i < batch.live(); ++i) {
+		flap[i] = y[i] > gap[i] + offset && vy[i] > 0.0f;
+	}
+}
+
+// Same rule with one offset per environment id, so a crowd of birds sharing
+// one obstacle stream spreads out instead of flying in lockstep.
+inline void heuristic_bot(const EnvBatch &batch, std::uint8_t *flap, const float *offset_by_env) {
+	const float *y = batch.y();
+	const float *vy = batch.vy();
+	const float *gap = batch.gap();
+	const std::uint32_t *env = batch.lane_env();
+	for (int i = 0; i < batch.live(); ++i) {
+		flap[i] = y[i] > gap[i] + offset_by_env[env[i]] && vy[i] > 0.0f;
+	}
+}
+
+// Flap when the bird, falling freely for `ticks` more ticks, would sink below
+// the gap center by a quarter of the gap. Looks ahead instead of reacting.
+inline bool predictive_flap(float y, float vy, float gap, float ticks, const Rules &rules) {
+	const float t = ticks * SIM_DT;
+	return y + vy * t + 0.5f * rules.gravity * t * t > gap + rules.gap_size / 4.0f && vy > 0.0f;
+}
+
+// A controller by name and parameter, so one batch can fly several kinds.
+struct BotSpec {
+	enum Kind : std::uint8_t { HEURISTIC, PREDICTIVE };
+
+	Kind kind = HEURISTIC;
+	// the offset of the heuristic bot, the look-ahead ticks of the predictive
+	float param = 40.0f;
+
+	static constexpr const char *KIND_NAMES[] = { "heuristic", "predict" };
+
+	// Parses "heuristic:OFFSET" or "predict:TICKS".
+	static bool parse(const char *text, BotSpec &spec) {
+		for (int kind = 0; kind < 2; ++kind) {
+			const std::size_t n = std::strlen(KIND_NAMES[kind]);
+			if (std::strncmp(text, KIND_NAMES[kind], n) == 0 && text[n] == ':') {
+				char *end;
+				spec.kind = static_cast<Kind>(kind);
+				spec.param = std::strtof(text + n + 1, &end);
+				return *end == '\0' && end != text + n + 1;
+			}
+		}
+		return false;
+	}
+
+	// Content key of the controller, for the evaluation cache.
+	std::uint64_t key() const { return Hasher().add(KIND_NAMES[kind]).add(param).value(); }
+};
+
+// One controller per environment id.
+inline void mixed_bots(const EnvBatch &batch, std::uint8_t *flap, const BotSpec *by_env) {
+	const float *y = batch.y();
+	const float *vy = batch.vy();
+	const float *gap = batch.gap();
+	const std::uint32_t *env = batch.lane_env();
+	const Rules &rules = batch.rules();
+	for (int i = 0; i < batch.live(); ++i) {
+		const BotSpec &bot = by_env[env[i]];
+		flap[i] = bot.kind == BotSpec::HEURISTIC ? y[i] > gap[i] + bot.param && vy[i] > 0.0f
+			: predictive_flap(y[i], vy[i], gap[i], bot.param, rules);
+	}
+}
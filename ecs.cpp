@@ -0,0 +1,243 @@
+#include "ecs.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace ecs {
+
+static TypeInfo types[MAX_TYPES];
+static std::atomic<int> type_count{0};
+
+int register_type(std::size_t size, std::size_t align) {
+	const int id = type_count.fetch_add(1);
+	if (id >= MAX_TYPES) {
+		std::fprintf(stderr, "ecs: more than %d component and resource types\n", MAX_TYPES);
+		std::abort();
+	}
+	types[id] = TypeInfo{size, align};
+	return id;
+}
+
+const TypeInfo &type_info(int id) {
+	return types[id];
+}
+
+struct Access {
+	const char *system;
+	ComponentMask reads;
+	ComponentMask writes;
+};
+
+static thread_local const Access *running = nullptr;
+
+void check_access(ComponentMask reads, ComponentMask writes) {
+	if (running && ((reads & ~(running->reads | running->writes)) != 0 || (writes & ~running->writes) != 0)) {
+		std::fprintf(stderr, "ecs: system %s touches components it did not declare\n", running->system);
+		std::abort();
+	}
+}
+
+}
+
+Archetype::Archetype(ComponentMask mask) : mask_(mask) {
+	std::fill(std::begin(column_of_), std::end(column_of_), -1);
+	for (int type = 0; type < ecs::MAX_TYPES; ++type) {
+		if (mask & (ComponentMask{1} << type)) {
+			column_of_[type] = columns_.size();
+			columns_.push_back(Column{type, ecs::type_info(type).size, nullptr});
+		}
+	}
+}
+
+Archetype::~Archetype() {
+	for (Column &c : columns_) {
+		::operator delete(c.data, std::align_val_t(COLUMN_ALIGN));
+	}
+}
+
+void Archetype::grow() {
+	const int capacity = std::max(64, 2 * capacity_);
+	for (Column &c : columns_) {
+		std::byte *data = static_cast<std::byte *>(::operator new(c.size * capacity, std::align_val_t(COLUMN_ALIGN)));
+		if (c.data) {
+			std::memcpy(data, c.data, c.size * entities_.size());
+			::operator delete(c.data, std::align_val_t(COLUMN_ALIGN));
+		}
+		c.data = data;
+	}
+	capacity_ = capacity;
+}
+
+int Archetype::push(Entity e) {
+	if (size() == capacity_) {
+		grow();
+	}
+	entities_.push_back(e);
+	return size() - 1;
+}
+
+bool Archetype::swap_remove(int row, Entity &moved) {
+	const int last = size() - 1;
+	if (row != last) {
+		for (Column &c : columns_) {
+			std::memcpy(c.data + row * c.size, c.data + last * c.size, c.size);
+		}
+		entities_[row] = moved = entities_[last];
+	}
+	entities_.pop_back();
+	return row != last;
+}
+
+World::~World() {
+	for (Resource &r : resources_) {
+		if (r.value) {
+			r.free(r.value);
+		}
+	}
+}
+
+Archetype &World::archetype(ComponentMask mask) {
+	for (const auto &a : archetypes_) {
+		if (a->mask() == mask) {
+			return *a;
+		}
+	}
+	archetypes_.push_back(std::make_unique<Archetype>(mask));
+	return *archetypes_.back();
+}
+
+Entity World::allocate(Archetype &a) {
+	std::uint32_t index;
+	if (!free_.empty()) {
+		index = free_.back();
+		free_.pop_back();
+	} else {
+		index = locations_.size();
+		locations_.push_back(Location{nullptr, 0, 0});
+	}
+	Location &at = locations_[index];
+	const Entity e{index, at.generation};
+	at.archetype = &a;
+	at.row = a.push(e);
+	return e;
+}
+
+void World::destroy(Entity e) {
+	if (!alive(e)) {
+		return;
+	}
+	Location &at = locations_[e.index];
+	Entity moved;
+	if (at.archetype->swap_remove(at.row, moved)) {
+		locations_[moved.index].row = at.row;
+	}
+	at.archetype = nullptr;
+	at.generation += 1;
+	free_.push_back(e.index);
+}
+
+int World::count() const {
+	int n = 0;
+	for (const auto &a : archetypes_) {
+		n += a->size();
+	}
+	return n;
+}
+
+void CommandBuffer::apply(World &world) {
+	for (Entity e : destroy_) {
+		world.destroy(e);
+	}
+	for (auto &create : create_) {
+		create(world);
+	}
+	destroy_.clear();
+	create_.clear();
+}
+
+void Schedule::add(const char *name, ComponentMask reads, ComponentMask writes, Run run) {
+	auto system = std::make_unique<System>();
+	system->name = name;
+	system->reads = reads;
+	system->writes = writes;
+	system->run = std::move(run);
+	const int self = systems_.size();
+	for (int i = 0; i < self; ++i) {
+		System &earlier = *systems_[i];
+		if ((earlier.writes & (reads | writes)) != 0 || (writes & earlier.reads) != 0) {
+			earlier.dependents.push_back(self);
+			system->dependencies += 1;
+		}
+	}
+	systems_.push_back(std::move(system));
+}
+
+void Schedule::run_system(World &world, System &system, ThreadPool &pool) {
+	const ecs::Access access{system.name, system.reads, system.writes};
+	ecs::running = &access;
+	system.run(world, system.commands);
+	ecs::running = nullptr;
+	for (int d : system.dependents) {
+		System &next = *systems_[d];
+		if (next.waiting.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+			pool.submit([this, &world, &next, &pool] { run_system(world, next, pool); });
+		}
+	}
+	done_.fetch_add(1, std::memory_order_release);
+	done_.notify_one();
+}
+
+void Schedule::run(World &world, ThreadPool *pool) {
+	const int n = systems_.size();
+	if (pool) {
+		done_.store(0, std::memory_order_relaxed);
+		for (auto &s : systems_) {
+			s->waiting.store(s->dependencies, std::memory_order_relaxed);
+		}
+		for (auto &s : systems_) {
+			if (s->dependencies == 0) {
+				System *system = s.get();
+				pool->submit([this, &world, system, pool] { run_system(world, *system, *pool); });
+			}
+		}
+		for (int done = 0; (done = done_.load(std::memory_order_acquire)) < n;) {
+			done_.wait(done, std::memory_order_acquire);
+		}
+	} else {
+		for (auto &s : systems_) {
+			const ecs::Access access{s->name, s->reads, s->writes};
+			ecs::running = &access;
+			s->run(world, s->commands);
+			ecs::running = nullptr;
+		}
+	}
+	for (auto &s : systems_) {
+		s->commands.apply(world);
+	}
+}
+
+void Schedule::describe(char *out, std::size_t size) const {
+	std::vector<int> level(systems_.size(), 0);
+	int levels = 0;
+	for (std::size_t i = 0; i < systems_.size(); ++i) {
+		for (int d : systems_[i]->dependents) {
+			level[d] = std::max(level[d], level[i] + 1);
+		}
+		levels = std::max(levels, level[i] + 1);
+	}
+	std::size_t used = 0;
+	out[0] = '\0';
+	for (int l = 0; l < levels; ++l) {
+		for (std::size_t i = 0; i < systems_.size() && used < size; ++i) {
+			if (level[i] == l) {
+				used += std::snprintf(out + used, size - used, "%s%s", used == 0 || out[used - 1] == ' ' ? "" : " ",
+					systems_[i]->name);
+			}
+		}
+		if (l + 1 < levels && used < size) {
+			used += std::snprintf(out + used, size - used, " |");
+		}
+	}
+}
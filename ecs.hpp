@@ -0,0 +1,251 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "thread_pool.hpp"
+
+// A small archetype entity-component system. Entities with the same set of
+// components live in one archetype, which stores each component as its own
+// column, so systems run flat loops over arrays the way EnvBatch does. Up to
+// 64 component and resource types, identified by bits of a ComponentMask.
+//
+// Systems declare what they read and write, and a Schedule runs the ones that
+// do not conflict in parallel. Structural changes, creating and destroying
+// entities, go through a per-system CommandBuffer and are applied in system
+// order after the tick, so results never depend on thread timing.
+
+using ComponentMask = std::uint64_t;
+
+namespace ecs {
+
+static constexpr int MAX_TYPES = 64;
+
+struct TypeInfo {
+	std::size_t size;
+	std::size_t align;
+};
+
+// Aborts past MAX_TYPES.
+int register_type(std::size_t size, std::size_t align);
+const TypeInfo &type_info(int id);
+
+// One id per type for the whole process, handed out on first use.
+template <typename T>
+int type_id() {
+	if constexpr (std::is_const_v<T>) {
+		return type_id<std::remove_const_t<T>>();
+	} else {
+		static const int id = register_type(sizeof(T), alignof(T));
+		return id;
+	}
+}
+
+// Aborts, naming the system, when the system running on this thread touches
+// something it did not declare. Outside systems anything goes.
+void check_access(ComponentMask reads, ComponentMask writes);
+
+}
+
+template <typename... T>
+ComponentMask mask_of() {
+	return (ComponentMask{0} | ... | (ComponentMask{1} << ecs::type_id<T>()));
+}
+
+struct Entity {
+	std::uint32_t index;
+	std::uint32_t generation;
+
+	bool operator==(const Entity &) const = default;
+};
+
+// The entities with exactly one set of components, a column per component.
+class Archetype final {
+private:
+	struct Column {
+		int type;
+		std::size_t size;
+		std::byte *data;
+	};
+
+	ComponentMask mask_;
+	std::vector<Column> columns_;
+	// column of each type id, -1 if absent
+	std::int8_t column_of_[ecs::MAX_TYPES];
+	std::vector<Entity> entities_;
+	int capacity_ = 0;
+
+	void grow();
+public:
+	// columns are aligned for vector loads
+	static constexpr std::size_t COLUMN_ALIGN = 64;
+
+	explicit Archetype(ComponentMask mask);
+	~Archetype();
+	Archetype(const Archetype&) = delete;
+	Archetype& operator=(const Archetype&) = delete;
+
+	ComponentMask mask() const { return mask_; }
+	int size() const { return entities_.size(); }
+	const Entity *entities() const { return entities_.data(); }
+
+	template <typename T>
+	T *column() const {
+		return reinterpret_cast<T *>(columns_[column_of_[ecs::type_id<T>()]].data);
+	}
+
+	// Appends a row with unset components and returns its number.
+	int push(Entity e);
+	// Moves the last row into `row`; returns the entity that moved, if any.
+	bool swap_remove(int row, Entity &moved);
+};//~ Archetype
+
+class World final {
+private:
+	struct Location {
+		Archetype *archetype;
+		int row;
+		std::uint32_t generation;
+	};
+
+	std::vector<std::unique_ptr<Archetype>> archetypes_;
+	std::vector<Location> locations_;
+	std::vector<std::uint32_t> free_;
+	struct Resource {
+		void *value = nullptr;
+		void (*free)(void *) = nullptr;
+	};
+	Resource resources_[ecs::MAX_TYPES];
+
+	Archetype &archetype(ComponentMask mask);
+	Entity allocate(Archetype &a);
+public:
+	World() = default;
+	~World();
+	World(const World&) = delete;
+	World& operator=(const World&) = delete;
+
+	template <typename... C>
+	Entity create(const C &...components) {
+		static_assert((std::is_trivially_copyable_v<C> && ...), "components are moved around with memcpy");
+		Archetype &a = archetype(mask_of<C...>());
+		const Entity e = allocate(a);
+		const int row = locations_[e.index].row;
+		((a.column<C>()[row] = components), ...);
+		return e;
+	}
+
+	void destroy(Entity e);
+	bool alive(Entity e) const { return e.index < locations_.size() && locations_[e.index].generation == e.generation
+		&& locations_[e.index].archetype; }
+	int count() const;
+
+	template <typename T>
+	T *get(Entity e) {
+		const Location &at = locations_[e.index];
+		return (at.archetype->mask() & mask_of<T>()) ? &at.archetype->column<T>()[at.row] : nullptr;
+	}
+
+	// Calls f(count, entities, columns...) once per archetype that has every C;
+	// a const C is read, any other C written.
+	template <typename... C, typename F>
+	void each(F &&f) {
+		ecs::check_access(mask_of<C...>(), (ComponentMask{0} | ... | (std::is_const_v<C> ? 0 : mask_of<C>())));
+		const ComponentMask wanted = mask_of<C...>();
+		for (const auto &a : archetypes_) {
+			if ((a->mask() & wanted) == wanted && a->size() != 0) {
+				f(a->size(), a->entities(), a->template column<std::remove_const_t<C>>()...);
+			}
+		}
+	}
+
+	template <typename T>
+	void set_resource(T value) {
+		Resource &r = resources_[ecs::type_id<T>()];
+		if (r.value) {
+			r.free(r.value);
+		}
+		r = Resource{new T(std::move(value)), [](void *p) { delete static_cast<T *>(p); }};
+	}
+
+	// A const T is read, any other T written.
+	template <typename T>
+	T &resource() {
+		using U = std::remove_const_t<T>;
+		ecs::check_access(mask_of<U>(), std::is_const_v<T> ? 0 : mask_of<U>());
+		return *static_cast<U *>(resources_[ecs::type_id<U>()].value);
+	}
+};//~ World
+
+// Deferred structural changes of one system.
+class CommandBuffer final {
+private:
+	std::vector<Entity> destroy_;
+	std::vector<std::function<void(World &)>> create_;
+public:
+	void destroy(Entity e) { destroy_.push_back(e); }
+
+	template <typename... C>
+	void create(const C &...components) {
+		create_.emplace_back([=](World &world) { world.create(components...); });
+	}
+
+	void apply(World &world);
+};//~ CommandBuffer
+
+// Reads and writes of a system, components and resources alike.
+template <typename... T>
+struct Reads {
+	static ComponentMask mask() { return mask_of<T...>(); }
+};
+
+template <typename... T>
+struct Writes {
+	static ComponentMask mask() { return mask_of<T...>(); }
+};
+
+// Systems in the order they were added. Two systems conflict when one writes
+// what the other reads or writes; a conflicting system waits for every
+// earlier one it conflicts with. The rest run in parallel on the pool.
+class Schedule final {
+public:
+	using Run = std::function<void(World &, CommandBuffer &)>;
+private:
+	struct System {
+		const char *name;
+		ComponentMask reads;
+		ComponentMask writes;
+		Run run;
+		std::vector<int> dependents;
+		int dependencies = 0;
+		std::atomic<int> waiting{0};
+		CommandBuffer commands;
+	};
+
+	std::vector<std::unique_ptr<System>> systems_;
+	std::atomic<int> done_{0};
+
+	void run_system(World &world, System &system, ThreadPool &pool);
+public:
+	template <typename R, typename W>
+	void add(const char *name, Run run) {
+		add(name, R::mask() | W::mask(), W::mask(), std::move(run));
+	}
+	void add(const char *name, ComponentMask reads, ComponentMask writes, Run run);
+
+	// Runs every system once, then applies their commands in order. Without a
+	// pool, systems run one after another on the calling thread. A worker may
+	// still be leaving the last system when this returns, so the pool has to
+	// be joined before the schedule is destroyed.
+	void run(World &world, ThreadPool *pool = nullptr);
+
+	// Independent sets of systems, as "a b | c | d e" for printing.
+	void describe(char *out, std::size_t size) const;
+};//~ Schedule
@@ -0,0 +1,130 @@
+#include "ecs_game.hpp"
+
+template <typename Sink>
+static void spawn_bird(Sink &sink, std::uint32_t seed, std::uint32_t env, float offset, const Rules &rules) {
+	Rng rng(seed);
+	const float gap = next_gap(rng, rules.gap_min, rules.gap_max);
+	sink.create(Position{PLAYER_START_X, SCREEN_HEIGHT / 2.0f}, Velocity{0.0f, 0.0f}, Pipe{SCREEN_WIDTH, gap},
+		Flight{seed, env, 0, 0, Flight::FLYING}, Dice{rng}, Pilot{offset, 0});
+}
+
+void spawn_flock(World &world, int birds, const EnvOptions &options, const float *offset) {
+	world.set_resource(Sim{options.rules, options.max_episode_ticks});
+	world.set_resource(Results{});
+	world.set_resource(DrawList{});
+	Spawner spawner{options.first_seed, options.seed_stride, options.episodes};
+	for (int env = 0; env < birds && spawner.episodes_left != 0; ++env) {
+		spawn_bird(world, spawner.next_seed, env, offset[env], options.rules);
+		spawner.next_seed += spawner.seed_stride;
+		spawner.episodes_left -= spawner.episodes_left != UNLIMITED_EPISODES;
+	}
+	world.set_resource(spawner);
+}
+
+// The reference bot, see heuristic_bot().
+static void pilot(World &world, CommandBuffer &) {
+	world.each<const Position, const Velocity, const Pipe, Pilot>(
+		[](int n, const Entity *, const Position *p, const Velocity *v, const Pipe *pipe, Pilot *pilot) {
+			for (int i = 0; i < n; ++i) {
+				pilot[i].flap = p[i].y > pipe[i].gap + pilot[i].offset && v[i].vy > 0.0f;
+			}
+		});
+}
+
+// Same order of operations as EnvBatch::step, so results match bit for bit.
+static void integrate(World &world, CommandBuffer &) {
+	const Rules &rules = world.resource<const Sim>().rules;
+	constexpr float inverse_mass = 1.0f / DRAGON_MASS;
+	const float dx = rules.horizontal_velocity * SIM_DT;
+	const float gravity = rules.gravity;
+	const float flap_force = rules.flap_force;
+	world.each<const Pilot, Position, Velocity, Flight>(
+		[&](int n, const Entity *, const Pilot *pilot, Position *p, Velocity *v, Flight *flight) {
+			for (int i = 0; i < n; ++i) {
+				p[i].x += dx;
+				p[i].y += v[i].vy * SIM_DT;
+				const float vy = v[i].vy + (gravity + v[i].force * inverse_mass) * SIM_DT;
+				const bool ceiling = p[i].y < 0.0f;
+				p[i].y = ceiling ? 0.0f : p[i].y;
+				v[i].vy = (ceiling || pilot[i].flap) ? 0.0f : vy;
+				v[i].force = pilot[i].flap ? flap_force : 0.0f;
+				flight[i].ticks += 1;
+			}
+		});
+}
+
+static void collide(World &world, CommandBuffer &) {
+	const Sim &sim = world.resource<const Sim>();
+	const float gap_size = sim.rules.gap_size;
+	const std::uint32_t max_ticks = sim.max_ticks;
+	world.each<const Position, const Pipe, Flight>(
+		[&](int n, const Entity *, const Position *p, const Pipe *pipe, Flight *flight) {
+			for (int i = 0; i < n; ++i) {
+				const bool dead = p[i].y > SCREEN_HEIGHT || obstacle_hit(p[i].x, p[i].y, pipe[i].x, pipe[i].gap, gap_size);
+				flight[i].ended = dead ? Flight::DEAD : flight[i].ticks >= max_ticks ? Flight::CUT_OFF : Flight::FLYING;
+			}
+		});
+}
+
+static void extract(World &world, CommandBuffer &) {
+	const float half_size = world.resource<const Sim>().rules.gap_size / 2.0f;
+	std::vector<DrawRect> &rects = world.resource<DrawList>().rects;
+	rects.clear();
+	world.each<const Position, const Pipe>([&](int n, const Entity *, const Position *p, const Pipe *pipe) {
+		const std::size_t first = rects.size();
+		rects.resize(first + 3 * n);
+		DrawRect *out = rects.data() + first;
+		for (int i = 0; i < n; ++i) {
+			out[3 * i] = DrawRect{p[i].x - PLAYER_RADIUS, p[i].y - PLAYER_RADIUS, 2 * PLAYER_RADIUS, 2 * PLAYER_RADIUS};
+			out[3 * i + 1] = DrawRect{pipe[i].x, 0.0f, OBSTACLE_WIDTH, pipe[i].gap - half_size};
+			out[3 * i + 2] = DrawRect{pipe[i].x, pipe[i].gap + half_size, OBSTACLE_WIDTH,
+				SCREEN_HEIGHT - pipe[i].gap - half_size};
+		}
+	});
+}
+
+// Scores passed pipes and draws the next gap.
+static void advance(World &world, CommandBuffer &) {
+	const Rules &rules = world.resource<const Sim>().rules;
+	world.each<const Position, Pipe, Dice, Flight>(
+		[&](int n, const Entity *, const Position *p, Pipe *pipe, Dice *dice, Flight *flight) {
+			for (int i = 0; i < n; ++i) {
+				if (flight[i].ended == Flight::FLYING && p[i].x > pipe[i].x) {
+					flight[i].score += 1;
+					pipe[i].x = p[i].x + SCREEN_WIDTH;
+					pipe[i].gap = next_gap(dice[i].rng, rules.gap_min, rules.gap_max);
+				}
+			}
+		});
+}
+
+// Reports finished episodes and replaces their birds while the budget lasts.
+static void respawn(World &world, CommandBuffer &commands) {
+	const Rules &rules = world.resource<const Sim>().rules;
+	Spawner &spawner = world.resource<Spawner>();
+	std::vector<EpisodeResult> &results = world.resource<Results>().episodes;
+	world.each<const Flight, const Pilot>([&](int n, const Entity *entity, const Flight *flight, const Pilot *pilot) {
+		for (int i = 0; i < n; ++i) {
+			if (flight[i].ended == Flight::FLYING) {
+				continue;
+			}
+			const Flight &f = flight[i];
+			results.push_back(EpisodeResult{f.seed, f.env, f.ticks, f.score, f.ended == Flight::CUT_OFF, nullptr, false});
+			commands.destroy(entity[i]);
+			if (spawner.episodes_left != 0) {
+				spawner.episodes_left -= spawner.episodes_left != UNLIMITED_EPISODES;
+				spawn_bird(commands, spawner.next_seed, f.env, pilot[i].offset, rules);
+				spawner.next_seed += spawner.seed_stride;
+			}
+		}
+	});
+}
+
+void add_flappy_systems(Schedule &schedule) {
+	schedule.add<Reads<Position, Velocity, Pipe>, Writes<Pilot>>("pilot", pilot);
+	schedule.add<Reads<Pilot, Sim>, Writes<Position, Velocity, Flight>>("integrate", integrate);
+	schedule.add<Reads<Position, Pipe, Sim>, Writes<Flight>>("collide", collide);
+	schedule.add<Reads<Position, Pipe, Sim>, Writes<DrawList>>("extract", extract);
+	schedule.add<Reads<Position, Sim>, Writes<Pipe, Dice, Flight>>("advance", advance);
+	schedule.add<Reads<Flight, Pilot, Sim>, Writes<Spawner, Results>>("respawn", respawn);
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "ecs.hpp"
+#include "env.hpp"
+#include "game.hpp"
+
+// The headless game as ECS components and systems, the same simulation as
+// EnvBatch: a bird is an entity carrying its own next pipe, so a crowd of
+// independent games is one archetype. Each tick runs
+//
+//	pilot | integrate | collide extract | advance | respawn
+//
+// where collide and extract, which only share reads, run in parallel.
+
+struct Position {
+	float x;
+	float y;
+};
+
+struct Velocity {
+	float vy;
+	// flap force applied on the next tick
+	float force;
+};
+
+// The next pipe of a bird.
+struct Pipe {
+	float x;
+	float gap;
+};
+
+struct Flight {
+	enum Ended : std::uint8_t { FLYING, DEAD, CUT_OFF };
+
+	std::uint32_t seed;
+	std::uint32_t env;
+	std::uint32_t ticks;
+	std::int32_t score;
+	Ended ended;
+};
+
+struct Dice {
+	Rng rng;
+};
+
+// The reference bot and what it decided this tick.
+struct Pilot {
+	float offset;
+	std::uint8_t flap;
+};
+
+// Resources.
+struct Sim {
+	Rules rules;
+	std::uint32_t max_ticks = 10 * 60 * 60;
+};
+
+struct Spawner {
+	std::uint32_t next_seed = 1;
+	std::uint32_t seed_stride = 1;
+	std::uint64_t episodes_left = UNLIMITED_EPISODES;
+};
+
+struct Results {
+	// episodes finished since the owner last cleared it; no flap traces
+	std::vector<EpisodeResult> episodes;
+};
+
+struct DrawRect {
+	float x;
+	float y;
+	float width;
+	float height;
+};
+
+// What a renderer would draw: every bird and both halves of its pipe.
+struct DrawList {
+	std::vector<DrawRect> rects;
+};
+
+// Sets up the resources and starts min(birds, episodes) birds, like an
+// EnvBatch of `birds` lanes; bird `env` flies with offset[env].
+void spawn_flock(World &world, int birds, const EnvOptions &options, const float *offset);
+
+void add_flappy_systems(Schedule &schedule);
@@ -0,0 +1,230 @@
+#include "env.hpp"
+
+#include <algorithm>
+#include <utility>
+
+#ifdef __AVX512F__
+#include <immintrin.h>
+#endif
+
+std::size_t EnvBatch::memory_needed(int size, const EnvOptions &options) {
+	const std::size_t per_slot = 6 * sizeof(float) + 5 * sizeof(std::uint32_t) + sizeof(Rng)
+		+ 2 * sizeof(Arena) + 2 * sizeof(FlapChunk *) + sizeof(bool) + sizeof(EpisodeResult)
+		+ sizeof(InitialState) + options.slot_arena_bytes;
+	const std::size_t course = options.share_course ? course_length(options) * sizeof(float) : 0;
+	// every array and arena half is cache-line aligned
+	return size * per_slot + course + (20 + 2 * size) * Arena::CACHE_LINE;
+}
+
+std::uint32_t EnvBatch::course_length(const EnvOptions &options) {
+	const double distance = static_cast<double>(options.max_episode_ticks) * options.rules.horizontal_velocity * SIM_DT;
+	return static_cast<std::uint32_t>(distance / SCREEN_WIDTH) + 2;
+}
+
+EnvBatch::EnvBatch(int size, Arena &memory, const EnvOptions &options)
+	: size_(size), live_(static_cast<int>(std::min<std::uint64_t>(size, options.episodes))),
+	  next_seed_(options.first_seed), seed_stride_(options.seed_stride),
+	  episodes_left_(options.episodes - live_), rules_(options.rules),
+	  max_episode_ticks_(options.max_episode_ticks) {
+	x_ = memory.make_array<float>(size);
+	y_ = memory.make_array<float>(size);
+	vy_ = memory.make_array<float>(size);
+	force_ = memory.make_array<float>(size);
+	obstacle_x_ = memory.make_array<float>(size);
+	gap_ = memory.make_array<float>(size);
+	score_ = memory.make_array<std::int32_t>(size);
+	ticks_ = memory.make_array<std::uint32_t>(size);
+	env_ = memory.make_array<std::uint32_t>(size);
+	alive_ = memory.make_array<std::uint32_t>(size);
+
+	seed_ = memory.make_array<std::uint32_t>(size);
+	rng_ = memory.make_array<Rng>(size);
+	slot_arena_ = memory.make_array<Arena>(size);
+	spare_arena_ = memory.make_array<Arena>(size);
+	trace_head_ = memory.make_array<FlapChunk *>(size);
+	trace_tail_ = memory.make_array<FlapChunk *>(size);
+	trace_truncated_ = memory.make_array<bool>(size);
+	finished_ = memory.make_array<EpisodeResult>(size);
+	ready_ = memory.make_array<InitialState>(size);
+
+	if (options.share_course) {
+		// the same draws every environment's engine would make
+		course_length_ = course_length(options);
+		course_ = memory.make_array<float>(course_length_);
+		Rng rng(options.first_seed);
+		for (std::uint32_t k = 0; k < course_length_; ++k) {
+			course_[k] = next_gap(rng, rules_.gap_min, rules_.gap_max);
+		}
+	}
+
+	for (int i = 0; i < size_; ++i) {
+		slot_arena_[i] = memory.carve(options.slot_arena_bytes / 2);
+		spare_arena_[i] = memory.carve(options.slot_arena_bytes / 2);
+		env_[i] = i;
+	}
+	for (int i = 0; i < live_; ++i) {
+		reset_lane(i);
+	}
+}
+
+EnvBatch::InitialState EnvBatch::make_initial_state() {
+	InitialState state{next_seed_, 0.0f, Rng{}};
+	next_seed_ += seed_stride_;
+	if (course_) {
+		state.gap = course_[0];
+		return state;
+	}
+	state.rng.seed(state.seed);
+	state.gap = next_gap(state.rng, rules_.gap_min, rules_.gap_max);
+	return state;
+}
+
+void EnvBatch::prepare_resets() {
+	while (ready_count_ < size_) {
+		ready_[(ready_head_ + ready_count_) % size_] = make_initial_state();
+		ready_count_ += 1;
+	}
+}
+
+void EnvBatch::reset_lane(int lane) {
+	InitialState state;
+	if (ready_count_ != 0) {
+		state = ready_[ready_head_];
+		ready_head_ = (ready_head_ + 1) % size_;
+		ready_count_ -= 1;
+	} else {
+		state = make_initial_state();
+	}
+
+	const std::uint32_t env = env_[lane];
+	seed_[env] = state.seed;
+	rng_[env] = state.rng;
+	// the finished episode's flaps stay readable until this env resets again
+	std::swap(slot_arena_[env], spare_arena_[env]);
+	slot_arena_[env].reset();
+	trace_head_[env] = trace_tail_[env] = nullptr;
+	trace_truncated_[env] = false;
+
+	x_[lane] = PLAYER_START_X;
+	y_[lane] = SCREEN_HEIGHT / 2.0f;
+	vy_[lane] = 0.0f;
+	force_[lane] = 0.0f;
+	obstacle_x_[lane] = SCREEN_WIDTH;
+	gap_[lane] = state.gap;
+	score_[lane] = 0;
+	ticks_[lane] = 0;
+	alive_[lane] = 1;
+}
+
+void EnvBatch::record_flap(int lane) {
+	const std::uint32_t env = env_[lane];
+	FlapChunk *tail = trace_tail_[env];
+	if (!tail || tail->count == sizeof(tail->ticks) / sizeof(tail->ticks[0])) {
+		void *p = slot_arena_[env].allocate(sizeof(FlapChunk), alignof(FlapChunk));
+		if (!p) {
+			trace_truncated_[env] = true;
+			return;
+		}
+		FlapChunk *chunk = new (p) FlapChunk{nullptr, 0, {}};
+		if (tail) {
+			tail->next = chunk;
+		} else {
+			trace_head_[env] = chunk;
+		}
+		trace_tail_[env] = tail = chunk;
+	}
+	tail->ticks[tail->count++] = ticks_[lane];
+}
+
+void EnvBatch::step(const std::uint8_t *flap) {
+	// Same order as Player::physics followed by Player::flap in the game: the
+	// flap force is applied on the next tick. The rules are read into locals,
+	// since the stores below might alias the members as far as the compiler
+	// knows, which would keep the loop from vectorizing.
+	constexpr float inverse_mass = 1.0f / DRAGON_MASS;
+	const float dx = rules_.horizontal_velocity * SIM_DT;
+	const float gravity = rules_.gravity;
+	const float flap_force = rules_.flap_force;
+	const float gap_size = rules_.gap_size;
+	for (int i = 0; i < live_; ++i) {
+		x_[i] += dx;
+		y_[i] += vy_[i] * SIM_DT;
+		const float vy = vy_[i] + (gravity + force_[i] * inverse_mass) * SIM_DT;
+		const bool ceiling = y_[i] < 0.0f;
+		y_[i] = ceiling ? 0.0f : y_[i];
+		vy_[i] = (ceiling || flap[i]) ? 0.0f : vy;
+		force_[i] = flap[i] ? flap_force : 0.0f;
+		ticks_[i] += 1;
+	}
+
+	finished_count_ = 0;
+	for (int i = 0; i < live_; ++i) {
+		if (!alive_[i]) {
+			continue;
+		}
+		if (flap[i]) {
+			record_flap(i);
+		}
+		const bool dead = y_[i] > SCREEN_HEIGHT || obstacle_hit(x_[i], y_[i], obstacle_x_[i], gap_[i], gap_size);
+		if (dead || ticks_[i] >= max_episode_ticks_) {
+			const std::uint32_t env = env_[i];
+			finished_[finished_count_++] = EpisodeResult{seed_[env], env, ticks_[i], score_[i], !dead,
+				trace_head_[env], trace_truncated_[env]};
+			if (episodes_left_ != 0) {
+				episodes_left_ -= episodes_left_ != UNLIMITED_EPISODES;
+				reset_lane(i);
+			} else {
+				alive_[i] = 0;
+				dead_ += 1;
+			}
+		} else if (x_[i] > obstacle_x_[i]) {
+			score_[i] += 1;
+			obstacle_x_[i] = x_[i] + SCREEN_WIDTH;
+			gap_[i] = course_ ? course_[std::min<std::uint32_t>(score_[i], course_length_ - 1)]
+				: next_gap(rng_[env_[i]], rules_.gap_min, rules_.gap_max);
+		}
+	}
+
+	if (dead_ != 0 && (dead_ == live_ || (compaction_ && dead_ * COMPACT_DIVISOR >= live_))) {
+		compact();
+	}
+}
+
+// Stable in-place compaction of one lane column: element i moves to the number
+// of live lanes before it. Lanes only ever move down, so no scratch is needed.
+template <typename T>
+static int compress(T *column, const std::uint32_t *alive, int n) {
+	static_assert(sizeof(T) == sizeof(std::uint32_t));
+	int dst = 0;
+	int i = 0;
+#ifdef __AVX512F__
+	for (; i + 16 <= n; i += 16) {
+		const __m512i keep = _mm512_loadu_si512(alive + i);
+		const __mmask16 mask = _mm512_test_epi32_mask(keep, keep);
+		_mm512_mask_compressstoreu_epi32(column + dst, mask, _mm512_loadu_si512(column + i));
+		dst += __builtin_popcount(mask);
+	}
+#endif
+	for (; i < n; ++i) {
+		column[dst] = column[i];
+		dst += alive[i] != 0;
+	}
+	return dst;
+}
+
+void EnvBatch::compact() {
+	// Retired environments never come back, so their ids are simply dropped;
+	// the live ones keep their relative order.
+	compress(x_, alive_, live_);
+	compress(y_, alive_, live_);
+	compress(vy_, alive_, live_);
+	compress(force_, alive_, live_);
+	compress(obstacle_x_, alive_, live_);
+	compress(gap_, alive_, live_);
+	compress(score_, alive_, live_);
+	compress(ticks_, alive_, live_);
+	const int live = compress(env_, alive_, live_);
+	live_ = live;
+	std::fill(alive_, alive_ + live_, 1);
+	dead_ = 0;
+}
@@ -0,0 +1,177 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "arena.hpp"
+#include "game.hpp"
+
+// Flap ticks of one episode, as a list of chunks in the environment's arena.
+struct FlapChunk {
+	FlapChunk *next;
+	std::uint32_t count;
+	std::uint32_t ticks[61];
+};
+
+template <typename F>
+void for_each_flap(const FlapChunk *chunk, F &&f) {
+	for (; chunk; chunk = chunk->next) {
+		for (std::uint32_t i = 0; i < chunk->count; ++i) {
+			f(chunk->ticks[i]);
+		}
+	}
+}
+
+struct EpisodeResult {
+	std::uint32_t seed;
+	std::uint32_t env;
+	std::uint32_t ticks;
+	std::int32_t score;
+	bool truncated;
+	// valid until the next step()
+	const FlapChunk *flaps;
+	bool flaps_truncated;
+};
+
+static constexpr std::uint64_t UNLIMITED_EPISODES = ~std::uint64_t{0};
+
+struct EnvOptions {
+	std::uint32_t first_seed = 1;
+	// distance between consecutive episode seeds; 0 replays first_seed forever
+	std::uint32_t seed_stride = 1;
+	// episodes started in total, after which finished lanes are retired
+	std::uint64_t episodes = UNLIMITED_EPISODES;
+	// per-environment memory for flap traces, half of it for the running
+	// episode and half for the one that just finished; 0 records no traces
+	std::size_t slot_arena_bytes = 16 * 1024;
+	Rules rules;
+	// episodes are cut off, and reported truncated, after this many ticks
+	std::uint32_t max_episode_ticks = 10 * 60 * 60;
+	// Only with seed_stride 0, where every episode flies the same course:
+	// generates its gaps once up front instead of once per bird and pipe.
+	bool share_course = false;
+};
+
+// Many independent games advanced together by SIM_DT per step(). The state is
+// kept as structure-of-arrays so the physics loop vectorizes. All memory comes
+// from the arena given at construction; every environment additionally owns a
+// small arena for its per-episode data, which is rewound when the episode
+// restarts.
+//
+// Hot state is indexed by lane, and lanes [0, live()) are the ones stepped.
+// Once an episode budget runs out, finished lanes stay dead and are squeezed
+// out periodically, so the live lanes remain dense. Environments keep a stable
+// id, lane_env() maps a lane to it, and per-environment data is indexed by id.
+class EnvBatch final {
+public:
+	// Bytes the constructor takes from its arena.
+	static std::size_t memory_needed(int size, const EnvOptions &options = {});
+
+	// Starts min(size, options.episodes) episodes right away.
+	EnvBatch(int size, Arena &memory, const EnvOptions &options = {});
+	EnvBatch(const EnvBatch&) = delete;
+	EnvBatch& operator=(const EnvBatch&) = delete;
+
+	int size() const { return size_; }
+	int live() const { return live_; }
+	// Lanes still running an episode; live() also counts retired lanes that
+	// have not been squeezed out yet.
+	int active() const { return live_ - dead_; }
+
+	// Lane arrays, valid for [0, live()).
+	const float *x() const { return x_; }
+	const float *y() const { return y_; }
+	const float *vy() const { return vy_; }
+	const float *obstacle_x() const { return obstacle_x_; }
+	const float *gap() const { return gap_; }
+	const std::int32_t *score() const { return score_; }
+	const std::uint32_t *ticks() const { return ticks_; }
+	const std::uint32_t *lane_env() const { return env_; }
+	const std::uint32_t *alive() const { return alive_; }
+
+	// Environment arrays, indexed by id.
+	const std::uint32_t *seed() const { return seed_; }
+
+	const Rules &rules() const { return rules_; }
+
+	// Advances every live lane by one tick. A lane whose bird died (or ran for
+	// max_episode_ticks) is reported in finished() and restarted right away
+	// while the episode budget lasts; otherwise it is retired.
+	void step(const std::uint8_t *flap);
+
+	// Generates initial states (seed, engine, first gap) for upcoming resets,
+	// so a restart inside step() is a plain copy. Call it between steps, e.g.
+	// while the agents decide; step() falls back to generating inline when
+	// the queue runs dry. Seeds are handed out in the same order either way.
+	void prepare_resets();
+
+	const EpisodeResult *finished() const { return finished_; }
+	int finished_count() const { return finished_count_; }
+
+	// Turns the squeezing of dead lanes off, to measure what it buys.
+	void set_compaction(bool enabled) { compaction_ = enabled; }
+
+	// Flaps of the episode running in environment `env`. The trace stops
+	// early, and trace_truncated() is set, when the environment's arena runs
+	// out.
+	const FlapChunk *trace(int env) const { return trace_head_[env]; }
+	bool trace_truncated(int env) const { return trace_truncated_[env]; }
+private:
+	// Dead lanes are squeezed out once they make up 1/COMPACT_DIVISOR of live().
+	static constexpr int COMPACT_DIVISOR = 8;
+
+	struct InitialState {
+		std::uint32_t seed;
+		float gap;
+		Rng rng;
+	};
+
+	// Pipes an episode can reach within max_episode_ticks, plus the first.
+	static std::uint32_t course_length(const EnvOptions &options);
+
+	InitialState make_initial_state();
+	void reset_lane(int lane);
+	void record_flap(int lane);
+	void compact();
+
+	int size_;
+	int live_;
+	int dead_ = 0;
+	bool compaction_ = true;
+	std::uint32_t next_seed_;
+	std::uint32_t seed_stride_;
+	std::uint64_t episodes_left_;
+	Rules rules_;
+	std::uint32_t max_episode_ticks_;
+	// the shared course, gap k is the gap after scoring k; null if not shared
+	float *course_ = nullptr;
+	std::uint32_t course_length_ = 0;
+
+	float *x_;
+	float *y_;
+	float *vy_;
+	float *force_;
+	float *obstacle_x_;
+	float *gap_;
+	std::int32_t *score_;
+	std::uint32_t *ticks_;
+	std::uint32_t *env_;
+	std::uint32_t *alive_;
+
+	std::uint32_t *seed_;
+	Rng *rng_;
+	// the spare arena still holds the trace of the previous episode
+	Arena *slot_arena_;
+	Arena *spare_arena_;
+	FlapChunk **trace_head_;
+	FlapChunk **trace_tail_;
+	bool *trace_truncated_;
+
+	// ring of prepared resets, at most size_ are needed per step
+	InitialState *ready_;
+	int ready_head_ = 0;
+	int ready_count_ = 0;
+
+	EpisodeResult *finished_;
+	int finished_count_ = 0;
+};
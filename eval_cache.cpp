@@ -0,0 +1,326 @@
+#include "eval_cache.hpp"
+
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr char VALUES_MAGIC[4] = { 'F', 'L', 'E', 'V' };
+constexpr char INDEX_MAGIC[4] = { 'F', 'L', 'E', 'I' };
+constexpr std::uint32_t FORMAT_VERSION = 1;
+constexpr std::uint64_t INITIAL_RECORDS = 4096;
+// a slot is the record number plus one in the low bits, 0 when empty, and
+// the top bits of the key's hash above them to skip most mismatches
+constexpr int RECORD_BITS = 40;
+constexpr std::uint64_t RECORD_MASK = (std::uint64_t{1} << RECORD_BITS) - 1;
+
+std::uint64_t key_hash(const EvalKey &key) {
+	return Hasher().add(key.agent).add(key.rules).add(key.seed).value();
+}
+
+std::uint64_t key_tag(std::uint64_t hash) {
+	return hash >> RECORD_BITS;
+}
+
+}
+
+struct EvalCache::ValuesHeader {
+	char magic[4];
+	std::uint32_t version;
+	std::uint32_t record_bytes;
+	std::uint32_t reserved;
+	std::uint64_t count;
+	std::uint64_t capacity;
+};
+
+struct EvalCache::IndexHeader {
+	char magic[4];
+	std::uint32_t version;
+	std::uint64_t capacity;
+	std::uint64_t count;
+	std::uint64_t reserved;
+};
+
+struct EvalCache::Record {
+	std::uint64_t agent;
+	std::uint64_t rules;
+	std::uint32_t seed;
+	std::int32_t score;
+	std::uint32_t ticks;
+	std::uint32_t truncated;
+};
+
+template <typename T>
+static std::atomic_ref<T> shared(T &value) {
+	return std::atomic_ref<T>(value);
+}
+
+EvalCache::~EvalCache() {
+	unmap();
+	if (values_fd_ >= 0) {
+		close(values_fd_);
+	}
+	if (index_fd_ >= 0) {
+		close(index_fd_);
+	}
+}
+
+void EvalCache::unmap() {
+	if (values_) {
+		munmap(values_, values_bytes_);
+		values_ = nullptr;
+	}
+	if (index_) {
+		munmap(index_, index_bytes_);
+		index_ = nullptr;
+	}
+}
+
+bool EvalCache::open(const char *path, bool writable) {
+	path_ = path;
+	const std::string values_path = path_ + ".values";
+	writable_ = writable;
+	if (writable_) {
+		values_fd_ = ::open(values_path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+		if (values_fd_ >= 0 && flock(values_fd_, LOCK_EX | LOCK_NB) < 0) {
+			std::fprintf(stderr, "%s: another process is writing, opening read-only\n", values_path.c_str());
+			close(values_fd_);
+			values_fd_ = -1;
+			writable_ = false;
+		}
+	}
+	if (!writable_) {
+		values_fd_ = ::open(values_path.c_str(), O_RDONLY | O_CLOEXEC);
+	}
+	if (values_fd_ < 0) {
+		std::perror(values_path.c_str());
+		return false;
+	}
+
+	struct stat st;
+	fstat(values_fd_, &st);
+	if (st.st_size == 0 && writable_) {
+		ValuesHeader header = {};
+		std::memcpy(header.magic, VALUES_MAGIC, 4);
+		header.version = FORMAT_VERSION;
+		header.record_bytes = sizeof(Record);
+		header.capacity = INITIAL_RECORDS;
+		if (ftruncate(values_fd_, sizeof(ValuesHeader) + INITIAL_RECORDS * sizeof(Record)) < 0
+			|| pwrite(values_fd_, &header, sizeof(header), 0) != sizeof(header)) {
+			std::perror(values_path.c_str());
+			return false;
+		}
+	}
+	if (!map_values()) {
+		return false;
+	}
+
+	// the writer holds the lock, so the counts are stable
+	const bool indexed = map_index();
+	if (!writable_) {
+		if (!indexed) {
+			std::fprintf(stderr, "%s.index: missing, lookups miss until a writer rebuilds it\n", path);
+		}
+		return true;
+	}
+	if (!indexed || index_->count != values_->count) {
+		std::uint64_t capacity = 2 * INITIAL_RECORDS;
+		while (capacity < 2 * values_->count) {
+			capacity *= 2;
+		}
+		return rebuild_index(capacity);
+	}
+	return true;
+}
+
+bool EvalCache::map_values() {
+	struct stat st;
+	if (fstat(values_fd_, &st) < 0 || static_cast<std::size_t>(st.st_size) < sizeof(ValuesHeader)) {
+		std::fprintf(stderr, "%s.values: not an evaluation cache\n", path_.c_str());
+		return false;
+	}
+	void *p = mmap(nullptr, st.st_size, PROT_READ | (writable_ ? PROT_WRITE : 0), MAP_SHARED, values_fd_, 0);
+	if (p == MAP_FAILED) {
+		std::perror("eval cache: mmap");
+		return false;
+	}
+	if (values_) {
+		munmap(values_, values_bytes_);
+	}
+	values_ = static_cast<ValuesHeader *>(p);
+	values_bytes_ = st.st_size;
+	if (std::memcmp(values_->magic, VALUES_MAGIC, 4) != 0 || values_->version != FORMAT_VERSION
+		|| values_->record_bytes != sizeof(Record)) {
+		std::fprintf(stderr, "%s.values: not an evaluation cache of this version\n", path_.c_str());
+		return false;
+	}
+	return true;
+}
+
+bool EvalCache::map_index() {
+	const std::string index_path = path_ + ".index";
+	const int fd = ::open(index_path.c_str(), (writable_ ? O_RDWR : O_RDONLY) | O_CLOEXEC);
+	struct stat st;
+	if (fd < 0 || fstat(fd, &st) < 0 || static_cast<std::size_t>(st.st_size) < sizeof(IndexHeader)) {
+		if (fd >= 0) {
+			close(fd);
+		}
+		return false;
+	}
+	void *p = mmap(nullptr, st.st_size, PROT_READ | (writable_ ? PROT_WRITE : 0), MAP_SHARED, fd, 0);
+	if (p == MAP_FAILED) {
+		close(fd);
+		return false;
+	}
+	const IndexHeader *header = static_cast<const IndexHeader *>(p);
+	if (std::memcmp(header->magic, INDEX_MAGIC, 4) != 0 || header->version != FORMAT_VERSION
+		|| sizeof(IndexHeader) + header->capacity * sizeof(std::uint64_t) != static_cast<std::size_t>(st.st_size)) {
+		munmap(p, st.st_size);
+		close(fd);
+		return false;
+	}
+	if (index_) {
+		munmap(index_, index_bytes_);
+		close(index_fd_);
+	}
+	index_ = static_cast<IndexHeader *>(p);
+	index_bytes_ = st.st_size;
+	index_fd_ = fd;
+	index_inode_ = st.st_ino;
+	return true;
+}
+
+bool EvalCache::rebuild_index(std::uint64_t capacity) {
+	const std::string index_path = path_ + ".index";
+	const std::string temp_path = index_path + ".tmp";
+	const std::size_t bytes = sizeof(IndexHeader) + capacity * sizeof(std::uint64_t);
+	const int fd = ::open(temp_path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd < 0 || ftruncate(fd, bytes) < 0) {
+		std::perror(temp_path.c_str());
+		if (fd >= 0) {
+			close(fd);
+		}
+		return false;
+	}
+	void *p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (p == MAP_FAILED) {
+		std::perror(temp_path.c_str());
+		return false;
+	}
+	IndexHeader *index = static_cast<IndexHeader *>(p);
+	std::memcpy(index->magic, INDEX_MAGIC, 4);
+	index->version = FORMAT_VERSION;
+	index->capacity = capacity;
+	std::uint64_t *slots = reinterpret_cast<std::uint64_t *>(index + 1);
+	const Record *records = reinterpret_cast<const Record *>(values_ + 1);
+	const std::uint64_t count = shared(values_->count).load(std::memory_order_acquire);
+	for (std::uint64_t r = 0; r < count; ++r) {
+		const std::uint64_t hash = key_hash(EvalKey{records[r].agent, records[r].rules, records[r].seed});
+		std::uint64_t at = hash & (capacity - 1);
+		while (slots[at] != 0) {
+			at = (at + 1) & (capacity - 1);
+		}
+		slots[at] = (key_tag(hash) << RECORD_BITS) | (r + 1);
+	}
+	index->count = count;
+	munmap(p, bytes);
+	if (rename(temp_path.c_str(), index_path.c_str()) < 0) {
+		std::perror(index_path.c_str());
+		return false;
+	}
+	return map_index();
+}
+
+std::uint64_t EvalCache::size() const {
+	return index_ ? shared(index_->count).load(std::memory_order_acquire) : 0;
+}
+
+bool EvalCache::find(const EvalKey &key, EvalResult &result) const {
+	if (!index_) {
+		return false;
+	}
+	const std::uint64_t hash = key_hash(key);
+	const std::uint64_t tag = key_tag(hash);
+	const std::uint64_t capacity = index_->capacity;
+	std::uint64_t *slots = reinterpret_cast<std::uint64_t *>(index_ + 1);
+	const Record *records = reinterpret_cast<const Record *>(values_ + 1);
+	const std::uint64_t mapped = (values_bytes_ - sizeof(ValuesHeader)) / sizeof(Record);
+	for (std::uint64_t at = hash & (capacity - 1), probes = 0; probes < capacity; at = (at + 1) & (capacity - 1), ++probes) {
+		const std::uint64_t slot = shared(slots[at]).load(std::memory_order_acquire);
+		if (slot == 0) {
+			return false;
+		}
+		const std::uint64_t r = (slot & RECORD_MASK) - 1;
+		if ((slot >> RECORD_BITS) != tag || r >= mapped) {
+			continue;
+		}
+		const Record &record = records[r];
+		if (record.agent == key.agent && record.rules == key.rules && record.seed == key.seed) {
+			result = EvalResult{record.score, record.ticks, record.truncated != 0};
+			return true;
+		}
+	}
+	return false;
+}
+
+bool EvalCache::insert(const EvalKey &key, const EvalResult &result) {
+	if (!writable_) {
+		return false;
+	}
+	EvalResult known;
+	if (find(key, known)) {
+		return true;
+	}
+
+	const std::uint64_t count = values_->count;
+	if (count == values_->capacity) {
+		const std::uint64_t capacity = 2 * values_->capacity;
+		if (ftruncate(values_fd_, sizeof(ValuesHeader) + capacity * sizeof(Record)) < 0) {
+			std::perror("eval cache: grow values");
+			return false;
+		}
+		if (!map_values()) {
+			return false;
+		}
+		values_->capacity = capacity;
+	}
+	Record *records = reinterpret_cast<Record *>(values_ + 1);
+	records[count] = Record{key.agent, key.rules, key.seed, result.score, result.ticks, result.truncated};
+	shared(values_->count).store(count + 1, std::memory_order_release);
+
+	// at most half full, so probes stay short
+	if (2 * (index_->count + 1) > index_->capacity) {
+		return rebuild_index(2 * index_->capacity);
+	}
+	const std::uint64_t hash = key_hash(key);
+	const std::uint64_t capacity = index_->capacity;
+	std::uint64_t *slots = reinterpret_cast<std::uint64_t *>(index_ + 1);
+	std::uint64_t at = hash & (capacity - 1);
+	while (slots[at] != 0) {
+		at = (at + 1) & (capacity - 1);
+	}
+	shared(slots[at]).store((key_tag(hash) << RECORD_BITS) | (count + 1), std::memory_order_release);
+	shared(index_->count).store(index_->count + 1, std::memory_order_release);
+	return true;
+}
+
+bool EvalCache::refresh() {
+	struct stat st;
+	if (fstat(values_fd_, &st) == 0 && static_cast<std::size_t>(st.st_size) != values_bytes_ && !map_values()) {
+		return false;
+	}
+	const std::string index_path = path_ + ".index";
+	if (stat(index_path.c_str(), &st) == 0 && st.st_ino != index_inode_) {
+		map_index();
+	}
+	return true;
+}
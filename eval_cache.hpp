@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "game.hpp"
+#include "hash.hpp"
+
+// On-disk cache of single-game evaluations, keyed by content hashes of the
+// agent, the rules and the seed. Tools look every game up before playing it,
+// so re-running a tournament or a sweep only plays what changed.
+//
+// PATH.values holds fixed-size records, appended and never rewritten. PATH.index
+// is an open-addressing hash table of record numbers, mapped shared. The
+// writer appends a record, then publishes its slot with one atomic store, so
+// readers in other processes need no locks: they either see the finished
+// record or nothing. When the table fills up, the writer builds a bigger one
+// and renames it over the old; readers keep the old mapping, which stays
+// valid, until refresh(). A lost index is rebuilt from the values.
+//
+// One process at a time may write; the others open read-only. Within a
+// process, find() may run on many threads at once but not during insert().
+
+struct EvalKey {
+	std::uint64_t agent;
+	std::uint64_t rules;
+	std::uint32_t seed;
+};
+
+struct EvalResult {
+	std::int32_t score;
+	std::uint32_t ticks;
+	bool truncated;
+};
+
+// Bump when the simulation changes, which invalidates every cached result.
+static constexpr std::uint32_t EVAL_SIM_VERSION = 2;
+
+// The rules key: the rules themselves and the tick cap the games ran under.
+inline std::uint64_t rules_key(const Rules &rules, std::uint32_t max_ticks) {
+	return Hasher().add(EVAL_SIM_VERSION)
+		.add(rules.horizontal_velocity).add(rules.gravity).add(rules.flap_force)
+		.add(rules.gap_size).add(rules.gap_min).add(rules.gap_max)
+		.add(max_ticks).value();
+}
+
+class EvalCache final {
+private:
+	struct ValuesHeader;
+	struct IndexHeader;
+	struct Record;
+
+	std::string path_;
+	bool writable_ = false;
+	int values_fd_ = -1;
+	int index_fd_ = -1;
+	// mapped values; the writer maps the file's whole preallocated capacity
+	ValuesHeader *values_ = nullptr;
+	std::size_t values_bytes_ = 0;
+	IndexHeader *index_ = nullptr;
+	std::size_t index_bytes_ = 0;
+	std::uint64_t index_inode_ = 0;
+
+	bool map_values();
+	bool map_index();
+	bool rebuild_index(std::uint64_t capacity);
+	void unmap();
+public:
+	EvalCache() = default;
+	~EvalCache();
+	EvalCache(const EvalCache&) = delete;
+	EvalCache& operator=(const EvalCache&) = delete;
+
+	// Opens or creates the cache at PATH.values and PATH.index. Falls back to
+	// read-only, with a message, when another process is writing. Prints the
+	// reason and returns false on failure.
+	bool open(const char *path, bool writable = true);
+
+	bool writable() const { return writable_; }
+
+	// Records cached, as far as this process knows.
+	std::uint64_t size() const;
+
+	bool find(const EvalKey &key, EvalResult &result) const;
+
+	// Writer only; a key that is already cached keeps its first result.
+	bool insert(const EvalKey &key, const EvalResult &result);
+
+	// Readers: picks up what the writer added since open() or the last call.
+	bool refresh();
+};//~ EvalCache
@@ -0,0 +1,170 @@
+#include "evdev_input.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <linux/input.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr int KEY_BYTES = KEY_MAX / 8 + 1;
+
+bool has_key(const unsigned char *bits, int code) {
+	return bits[code / 8] & (1 << (code % 8));
+}
+
+bool action_of(int code, Action &action) {
+	switch (code) {
+	case KEY_SPACE:
+	case BTN_SOUTH:
+		action = Action::Flap;
+		return true;
+	case KEY_P:
+	case BTN_START:
+		action = Action::Play;
+		return true;
+	case KEY_Q:
+	case BTN_SELECT:
+		action = Action::Quit;
+		return true;
+	default:
+		return false;
+	}
+}
+
+double monotonic_now() {
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+}
+
+EvdevInput::~EvdevInput() {
+	if (reader_.joinable()) {
+		const std::uint64_t one = 1;
+		if (write(wake_fd_, &one, sizeof(one)) != sizeof(one)) {
+			std::perror("evdev: wake reader");
+		}
+		reader_.join();
+	}
+	for (int fd : fds_) {
+		close(fd);
+	}
+	if (wake_fd_ >= 0) {
+		close(wake_fd_);
+	}
+	if (epoll_fd_ >= 0) {
+		close(epoll_fd_);
+	}
+}
+
+bool EvdevInput::start(void (*on_press)()) {
+	on_press_ = on_press;
+	DIR *dir = opendir("/dev/input");
+	if (!dir) {
+		std::perror("evdev: /dev/input");
+		return false;
+	}
+	int denied = 0;
+	while (dirent *entry = readdir(dir)) {
+		if (std::strncmp(entry->d_name, "event", 5) != 0) {
+			continue;
+		}
+		char path[300];
+		std::snprintf(path, sizeof(path), "/dev/input/%s", entry->d_name);
+		const int fd = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+		if (fd < 0) {
+			denied += errno == EACCES;
+			continue;
+		}
+		unsigned char keys[KEY_BYTES] = {};
+		const int clock = CLOCK_MONOTONIC;
+		if (ioctl(fd, EVIOCGBIT(EV_KEY, sizeof(keys)), keys) < 0
+			|| !(has_key(keys, KEY_SPACE) || has_key(keys, BTN_SOUTH))
+			|| ioctl(fd, EVIOCSCLOCKID, &clock) < 0) {
+			close(fd);
+			continue;
+		}
+		fds_.push_back(fd);
+	}
+	closedir(dir);
+	if (fds_.empty()) {
+		std::fprintf(stderr, "evdev: no keyboard or gamepad%s\n",
+			denied != 0 ? " readable, is the user in the input group?" : " found");
+		return false;
+	}
+
+	epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+	wake_fd_ = eventfd(0, EFD_CLOEXEC);
+	if (epoll_fd_ < 0 || wake_fd_ < 0) {
+		std::perror("evdev: epoll");
+		return false;
+	}
+	epoll_event ev = {};
+	ev.events = EPOLLIN;
+	ev.data.fd = wake_fd_;
+	epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wake_fd_, &ev);
+	for (int fd : fds_) {
+		ev.data.fd = fd;
+		epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev);
+	}
+	reader_ = std::thread([this] { read_devices(); });
+	return true;
+}
+
+void EvdevInput::read_devices() {
+	epoll_event ready[16];
+	input_event events[64];
+	for (;;) {
+		const int n = epoll_wait(epoll_fd_, ready, 16, -1);
+		if (n < 0 && errno != EINTR) {
+			std::perror("evdev: epoll_wait");
+			return;
+		}
+		for (int i = 0; i < n; ++i) {
+			const int fd = ready[i].data.fd;
+			if (fd == wake_fd_) {
+				return;
+			}
+			ssize_t size;
+			while ((size = read(fd, events, sizeof(events))) > 0) {
+				for (std::size_t e = 0; e < size / sizeof(input_event); ++e) {
+					Action action;
+					// value 1 is a press; 0 releases and 2 repeats
+					if (events[e].type != EV_KEY || events[e].value != 1 || !action_of(events[e].code, action)) {
+						continue;
+					}
+					const double time = events[e].input_event_sec + events[e].input_event_usec * 1e-6;
+					if (!presses_.push(InputEvent{time, action, true})) {
+						dropped_.fetch_add(1, std::memory_order_relaxed);
+					} else if (on_press_) {
+						on_press_();
+					}
+				}
+			}
+			if (size < 0 && errno != EAGAIN && errno != EINTR) {
+				// unplugged
+				epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+			}
+		}
+	}
+}
+
+void EvdevInput::poll(double now, const InputView &, InputQueue &queue) {
+	const double offset = now - monotonic_now();
+	InputEvent event;
+	while (presses_.pop(event)) {
+		event.time = std::min(event.time + offset, now);
+		queue.push(event);
+	}
+}
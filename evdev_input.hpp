@@ -0,0 +1,49 @@
+#pragma once
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "input.hpp"
+#include "spsc_queue.hpp"
+
+// Linux only: reads keyboards and gamepads straight from /dev/input/event* on
+// a thread of its own, stamping every press with the kernel's CLOCK_MONOTONIC
+// time. A press is then known to the microsecond instead of to the frame that
+// happened to poll it, and the game can apply it at that point of the frame.
+//
+// Space or the bottom face button flaps, P or start plays, Q or select quits.
+// Needs read access to the devices, usually membership of the input group.
+class EvdevInput final : public InputSource {
+private:
+	std::vector<int> fds_;
+	int epoll_fd_ = -1;
+	int wake_fd_ = -1;
+	std::thread reader_;
+	// kernel time in seconds
+	SpscQueue<InputEvent, 256> presses_;
+	std::atomic<unsigned> dropped_{0};
+	void (*on_press_)() = nullptr;
+
+	void read_devices();
+public:
+	EvdevInput() = default;
+	~EvdevInput();
+	EvdevInput(const EvdevInput&) = delete;
+	EvdevInput& operator=(const EvdevInput&) = delete;
+
+	// Opens every device with the keys above and starts the reader; prints
+	// the reason and returns false if there is none. `on_press`, if given, is
+	// called on the reader thread after each press is queued, to wake a game
+	// loop that sleeps waiting for window events.
+	bool start(void (*on_press)() = nullptr);
+
+	int devices() const { return fds_.size(); }
+
+	// Moves the presses read so far to the game clock, taking `now` to be
+	// the current monotonic time on that clock.
+	void poll(double now, const InputView &view, InputQueue &queue) override;
+
+	// presses lost to a full queue
+	unsigned dropped() const { return dropped_.load(std::memory_order_relaxed); }
+};//~ EvdevInput
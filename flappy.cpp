@@ -1,12 +1,37 @@
 #include <raylib.h>
+#include <rlgl.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <optional>
 #include <random>
+#include <thread>
+#include <vector>
+
+#include "alloc_tracker.hpp"
+#include "bots.hpp"
+#include "env.hpp"
+#include "evdev_input.hpp"
+#include "frame_stream.hpp"
+#include "game.hpp"
+#include "input.hpp"
+#include "particles.hpp"
+#include "replay.hpp"
+#include "rules.hpp"
+#include "state_stream.hpp"
+#include "triple_buffer.hpp"
+
+// raylib polls events only from EndDrawing(); idle screens block in GLFW instead,
+// and evdev presses, which GLFW does not see, end the wait with an empty event.
+extern "C" void glfwWaitEventsTimeout(double timeout);
+extern "C" void glfwPostEmptyEvent(void);
 
-static constexpr int SCREEN_WIDTH = 800;
-static constexpr int SCREEN_HEIGHT = 600;
 static constexpr int FONT_SIZE = 20;
-static constexpr int GAP_SIZE = SCREEN_HEIGHT / 3;
 static constexpr Color TEXT_COLOR = MAROON;
-static constexpr int PLAYER_RADIUS = 15;
 
 static Font FONT;
 
@@ -22,15 +47,11 @@ class Obstacle;
 
 class Player final {
 private:
-	static constexpr float DRAGON_MASS = 1.0;
-	static constexpr float HORIZONTAL_VELOCITY = 120.0;
-	static constexpr float GRAV_ACCELERATION = 600.0;
-	static constexpr float FLAP_FORCE = -20000.0;
-
 	Vector2 pos{0, 0};
 	Vector2 vel{HORIZONTAL_VELOCITY, 0};
-	Vector2 acc{0, GRAV_ACCELERATION};
 	Vector2 force_accum{0, 0};
+	// game time the accumulated force still pushes for
+	float force_time = 0.0f;
 	float inverse_mass = 1.0 / DRAGON_MASS;
 
 	void add_force(float fx, float fy) {
@@ -43,31 +64,47 @@ public:
 		pos.y = y;
 	}
 
-	void render() {
-		DrawCircle(PLAYER_RADIUS, pos.y, PLAYER_RADIUS, RED);
+	// Drawn at height `y`, which lies between two ticks' positions.
+	void render(float y) {
+		DrawCircleV(Vector2{static_cast<float>(PLAYER_RADIUS), y}, PLAYER_RADIUS, RED);
 	}
 
-	void physics(float dt) {
+	void physics(float dt, const Rules &rules) {
+		vel.x = rules.horizontal_velocity;
 		pos.x += vel.x * dt; 	
 		pos.y += vel.y * dt;
 
-		Vector2 accel = acc;
-		accel.x += force_accum.x * inverse_mass;
-		accel.y += force_accum.y * inverse_mass;
-
-		vel.x += accel.x * dt;
-		vel.y += accel.y * dt;
+		// A flap pushes for one SIM_DT of game time, the same impulse as in
+		// the headless simulation, even when a mid-tick flap splits that time
+		// over two calls. A whole-step push keeps the headless arithmetic.
+		const float pushed = std::min(dt, force_time);
+		Vector2 accel{0, rules.gravity};
+		if (pushed == dt) {
+			accel.x += force_accum.x * inverse_mass;
+			accel.y += force_accum.y * inverse_mass;
+			vel.x += accel.x * dt;
+			vel.y += accel.y * dt;
+		} else {
+			vel.x += accel.x * dt + force_accum.x * inverse_mass * pushed;
+			vel.y += accel.y * dt + force_accum.y * inverse_mass * pushed;
+		}
 		if (pos.y < 0.0) {
 			pos.y = 0.0;
 			vel.y = 0.0;
 		}
 
-		force_accum.x = force_accum.y = 0.0;
+		force_time -= pushed;
+		if (force_time <= 0.0f) {
+			force_accum.x = force_accum.y = 0.0;
+			force_time = 0.0f;
+		}
 	}
 
-	void flap() {
+	void flap(const Rules &rules) {
 		vel.y = 0.0;
-		add_force(0.0, FLAP_FORCE);	
+		force_accum.x = force_accum.y = 0.0;
+		add_force(0.0, rules.flap_force);
+		force_time = SIM_DT;
 	}
 
 	friend class State;
@@ -76,51 +113,481 @@ public:
 
 class Obstacle final {
 private:
-	static constexpr int OBSTACLE_WIDTH = SCREEN_WIDTH / 20;
-	static constexpr int GROUND_HEIGHT = 15;
-	int x;
+	// float like EnvBatch's, so replays score and collide on the same tick
+	float x;
 	int gap;
 	int size;
 public:
-	Obstacle(int x, int gap, int size) : x(x), gap(gap), size(size) {}
+	Obstacle(float x, int gap, int size) : x(x), gap(gap), size(size) {}
 
-	static Obstacle create(int x, int score) {
-		static std::random_device r;
-		std::default_random_engine e(r());
-		std::uniform_int_distribution<int> u(SCREEN_HEIGHT/9, (SCREEN_HEIGHT * 8) / 10);
-		return Obstacle{x, u(e), GAP_SIZE};
+	static Obstacle create(float x, int score, Rng &rng, const Rules &rules = Rules{}) {
+		return Obstacle{x, next_gap(rng, rules.gap_min, rules.gap_max), rules.gap_size};
 	}
 
-	void render(int player_x) {
-		const int screen_x = x - player_x;
+	// Takes a fractional `player_x`, so the pipe scrolls smoothly when the
+	// frame rate is above the tick rate.
+	void render(float player_x) {
+		const float screen_x = x - player_x;
 		const int half_size = size / 2;
 		
 		// top
-		DrawRectangle(screen_x, 0, OBSTACLE_WIDTH, gap - half_size, BLUE);
+		DrawRectangleRec(Rectangle{screen_x, 0.0f, OBSTACLE_WIDTH, static_cast<float>(gap - half_size)}, BLUE);
 
 		// bottom
-		DrawRectangle(screen_x, gap+half_size, OBSTACLE_WIDTH, SCREEN_HEIGHT - gap - half_size, BLUE);
+		DrawRectangleRec(Rectangle{screen_x, static_cast<float>(gap + half_size), OBSTACLE_WIDTH,
+			static_cast<float>(SCREEN_HEIGHT - gap - half_size)}, BLUE);
 		DrawRectangle(0, SCREEN_HEIGHT - GROUND_HEIGHT, SCREEN_WIDTH, GROUND_HEIGHT, DARKGREEN);
 	}
 
 	bool is_hit(const Player &player) const {
-		const float half_size = size / 2.0;
-		Rectangle upper = { 1.0f * x, 0.0, OBSTACLE_WIDTH, gap - half_size };
-		Rectangle lower = { 1.0f * x, gap + half_size, OBSTACLE_WIDTH, SCREEN_HEIGHT - gap - half_size};
-		return CheckCollisionCircleRec(player.pos, PLAYER_RADIUS, upper) ||
-		       CheckCollisionCircleRec(player.pos, PLAYER_RADIUS, lower);
+		return obstacle_hit(player.pos.x, player.pos.y, x, gap, size);
 	}
 
 	friend class State;
 };
 
+// The scene is drawn in SCREEN_WIDTH x SCREEN_HEIGHT game coordinates into an
+// offscreen target, which is then stretched, letterboxed, into the resizable
+// window. In dynamic mode the target's resolution follows the measured frame
+// time: a slow machine trades pixels for frame rate, and a large window gets
+// more pixels while there is headroom.
+//
+// Static screens are kept in the target between frames. While neither they
+// nor the window change, a frame presents nothing and just sleeps until input
+// arrives, so an idle menu costs next to no CPU. Gamepad buttons do not wake
+// GLFW, and raylib samples them only when a frame is presented, so there is
+// no sleeping while a gamepad is connected.
+class Presenter final {
+private:
+	static constexpr float SCALES[] = { 0.5f, 0.625f, 0.75f, 0.875f, 1.0f, 1.25f, 1.5f, 1.75f, 2.0f };
+	static constexpr int SCALE_COUNT = sizeof(SCALES) / sizeof(SCALES[0]);
+	static constexpr int NATIVE_SCALE = 4;
+	// Drop a step above HIGH_WATER of the budget and add one below LOW_WATER.
+	// The gap between the two and the hold time keep the scale from flapping.
+	static constexpr double HIGH_WATER = 0.85;
+	static constexpr double LOW_WATER = 0.45;
+	static constexpr double MISSED_FRAME = 1.25;
+	static constexpr double HOLD_SECONDS = 1.0;
+	static constexpr double SMOOTHING = 0.1;
+	// re-present an idle screen this often in case the window was uncovered
+	static constexpr double IDLE_REFRESH_SECONDS = 1.0;
+
+	RenderTexture2D target_{};
+	int scale_ = NATIVE_SCALE;
+	int loaded_scale_ = -1;
+	bool dynamic_ = true;
+	double frame_start_ = 0.0;
+	double work_ = 0.0;
+	double last_change_ = 0.0;
+	int cached_screen_ = -1;
+	bool drawing_ = false;
+	bool waited_ = false;
+	bool frame_time_valid_ = true;
+	int presented_width_ = 0;
+	int presented_height_ = 0;
+	double last_present_ = 0.0;
+	bool idle_sleep_ = true;
+	// seconds per frame at the target frame rate
+	double frame_budget_ = 1.0 / 60.0;
+
+	void present() {
+		const float window_w = GetScreenWidth();
+		const float window_h = GetScreenHeight();
+		const float fit = std::min(window_w / SCREEN_WIDTH, window_h / SCREEN_HEIGHT);
+		const Rectangle source = { 0.0f, 0.0f, static_cast<float>(target_.texture.width),
+			-static_cast<float>(target_.texture.height) };
+		const Rectangle dest = { (window_w - SCREEN_WIDTH * fit) / 2, (window_h - SCREEN_HEIGHT * fit) / 2,
+			SCREEN_WIDTH * fit, SCREEN_HEIGHT * fit };
+		BeginDrawing();
+		ClearBackground(BLACK);
+		DrawTexturePro(target_.texture, source, dest, Vector2{0.0f, 0.0f}, 0.0f, WHITE);
+		EndDrawing();
+
+		presented_width_ = GetScreenWidth();
+		presented_height_ = GetScreenHeight();
+		last_present_ = GetTime();
+		// raylib's frame time spans the wait, so it is off for one more frame
+		frame_time_valid_ = !waited_;
+		waited_ = false;
+	}
+
+	// No point rendering more pixels than the window shows.
+	int max_scale() const {
+		const float fit = std::min(static_cast<float>(GetScreenWidth()) / SCREEN_WIDTH,
+			static_cast<float>(GetScreenHeight()) / SCREEN_HEIGHT);
+		int scale = 0;
+		while (scale + 1 < SCALE_COUNT && SCALES[scale + 1] <= fit) {
+			scale += 1;
+		}
+		return scale;
+	}
+
+	// Frame time spent before the buffer swap, or the whole frame when the
+	// target frame rate was missed.
+	void adapt(double work) {
+		const double frame = GetFrameTime();
+		work_ += ((frame > MISSED_FRAME * frame_budget_ ? frame : work) - work_) * SMOOTHING;
+
+		const double now = GetTime();
+		if (now - last_change_ < HOLD_SECONDS) {
+			return;
+		}
+		const int max = max_scale();
+		int scale = scale_;
+		if (scale > max) {
+			scale = max;
+		} else if (work_ > HIGH_WATER * frame_budget_ && scale > 0) {
+			scale -= 1;
+		} else if (work_ < LOW_WATER * frame_budget_ && scale < max) {
+			scale += 1;
+		}
+		if (scale != scale_) {
+			scale_ = scale;
+			last_change_ = now;
+			TraceLog(LOG_INFO, "render scale %.3f", SCALES[scale_]);
+		}
+	}
+public:
+	// A positive fixed_scale pins the resolution to the nearest step.
+	void load(float fixed_scale) {
+		dynamic_ = fixed_scale <= 0.0f;
+		if (!dynamic_) {
+			scale_ = 0;
+			for (int i = 1; i < SCALE_COUNT; ++i) {
+				if (std::abs(SCALES[i] - fixed_scale) < std::abs(SCALES[scale_] - fixed_scale)) {
+					scale_ = i;
+				}
+			}
+		}
+		last_change_ = GetTime();
+	}
+
+	void unload() {
+		if (loaded_scale_ >= 0) {
+			UnloadRenderTexture(target_);
+			loaded_scale_ = -1;
+		}
+	}
+
+	void begin_frame() {
+		frame_start_ = GetTime();
+		if (loaded_scale_ != scale_) {
+			unload();
+			target_ = LoadRenderTexture(SCREEN_WIDTH * SCALES[scale_], SCREEN_HEIGHT * SCALES[scale_]);
+			SetTextureFilter(target_.texture, TEXTURE_FILTER_BILINEAR);
+			loaded_scale_ = scale_;
+		}
+		cached_screen_ = -1;
+		drawing_ = true;
+		BeginTextureMode(target_);
+		BeginMode2D(Camera2D{ Vector2{0.0f, 0.0f}, Vector2{0.0f, 0.0f}, 0.0f, SCALES[scale_] });
+	}
+
+	// The frame time the dynamic scale aims for: the display's refresh
+	// interval, or the target frame rate's.
+	void set_frame_budget(double seconds) { frame_budget_ = seconds; }
+
+	// Scripted runs must not wait for input that never comes.
+	void set_idle_sleep(bool enabled) { idle_sleep_ = enabled; }
+
+	// Like begin_frame() for a screen that changes only when `screen` does.
+	// Returns false, without starting to draw, while the target still holds it.
+	bool begin_static_frame(int screen) {
+		if (screen == cached_screen_ && loaded_scale_ == scale_) {
+			return false;
+		}
+		begin_frame();
+		cached_screen_ = screen;
+		return true;
+	}
+
+	void end_frame() {
+		if (!drawing_) {
+			const double since_present = GetTime() - last_present_;
+			if (idle_sleep_ && !IsGamepadAvailable(0) && GetScreenWidth() == presented_width_
+				&& GetScreenHeight() == presented_height_ && since_present < IDLE_REFRESH_SECONDS) {
+				glfwWaitEventsTimeout(IDLE_REFRESH_SECONDS - since_present);
+				waited_ = true;
+				frame_time_valid_ = false;
+				return;
+			}
+			present();
+			return;
+		}
+
+		EndMode2D();
+		EndTextureMode();
+		drawing_ = false;
+		const double work = GetTime() - frame_start_;
+		present();
+		if (dynamic_ && frame_time_valid_) {
+			adapt(work);
+		}
+	}
+};//~ Presenter
+
+static Presenter PRESENTER;
+
+// A white bird drawn once into a texture. Birds drawn from it with a tint all
+// share one texture, so raylib batches any number of them together.
+static RenderTexture2D load_bird_sprite() {
+	RenderTexture2D sprite = LoadRenderTexture(2 * PLAYER_RADIUS, 2 * PLAYER_RADIUS);
+	BeginTextureMode(sprite);
+	ClearBackground(BLANK);
+	DrawCircle(PLAYER_RADIUS, PLAYER_RADIUS, PLAYER_RADIUS, WHITE);
+	EndTextureMode();
+	return sprite;
+}
+
+// Translucent birds replaying the best recorded runs of one seed. Their
+// heights come from the decimated tracks in the mapped replay files.
+class Ghosts final {
+private:
+	static constexpr Color GHOST_COLOR = { 80, 80, 80, 70 };
+
+	std::vector<ReplayFile> replays_;
+	RenderTexture2D sprite_;
+public:
+	explicit Ghosts(std::vector<ReplayFile> replays) : replays_(std::move(replays)) {
+		sprite_ = load_bird_sprite();
+	}
+
+	~Ghosts() {
+		UnloadRenderTexture(sprite_);
+	}
+
+	Ghosts(const Ghosts&) = delete;
+	Ghosts& operator=(const Ghosts&) = delete;
+
+	std::uint32_t seed() const { return replays_.front().header().seed; }
+	int count() const { return replays_.size(); }
+
+	// Shows the ghosts at `tick` of their runs, fractional between two ticks.
+	void render(float tick) {
+		for (const ReplayFile &replay : replays_) {
+			float y;
+			if (replay.y_at(tick, y)) {
+				DrawTextureV(sprite_.texture, Vector2{0.0f, y - PLAYER_RADIUS}, GHOST_COLOR);
+			}
+		}
+	}
+};//~ Ghosts
+
+// Parallax scenery behind the play field: sky, far hills, clouds and near
+// hills, each scrolling at its own share of the camera's speed. A layer is
+// drawn once, at load, into a texture that repeats horizontally; a frame then
+// draws it as one quad whose texture coordinates slide with the camera, so the
+// background costs a draw per layer however much detail the layers hold.
+class Background final {
+private:
+	// Only the width is a power of two. Desktop GL repeats textures of any
+	// size, but a GLES2 build would need power-of-two layer heights as well.
+	static constexpr int LAYER_WIDTH = 1024;
+	static constexpr int LAYER_COUNT = 4;
+
+	struct Layer {
+		RenderTexture2D texture;
+		float y;
+		float height;
+		// of the camera's movement
+		float rate;
+	};
+
+	Layer layers_[LAYER_COUNT];
+
+	// Draws a circle and its copies one layer width to either side, so shapes
+	// cut by an edge continue across the seam.
+	static void draw_wrapped_circle(float x, float y, float radius, Color color) {
+		for (float dx : { -static_cast<float>(LAYER_WIDTH), 0.0f, static_cast<float>(LAYER_WIDTH) }) {
+			DrawCircleV(Vector2{x + dx, y}, radius, color);
+		}
+	}
+
+	// Loads a layer's texture and starts drawing into it; EndTextureMode()
+	// finishes it.
+	static Layer begin_layer(float y, float height, float rate) {
+		Layer layer{LoadRenderTexture(LAYER_WIDTH, static_cast<int>(height)), y, height, rate};
+		SetTextureWrap(layer.texture.texture, TEXTURE_WRAP_REPEAT);
+		SetTextureFilter(layer.texture.texture, TEXTURE_FILTER_BILINEAR);
+		BeginTextureMode(layer.texture);
+		ClearBackground(BLANK);
+		return layer;
+	}
+
+	static Layer make_hills(Rng &rng, float height, float rate, int count, float min_radius, float max_radius,
+		Color color) {
+		Layer layer = begin_layer(SCREEN_HEIGHT - GROUND_HEIGHT - height, height, rate);
+		std::uniform_real_distribution<float> x(0.0f, LAYER_WIDTH);
+		std::uniform_real_distribution<float> radius(min_radius, max_radius);
+		for (int i = 0; i < count; ++i) {
+			const float r = radius(rng);
+			// hill tops between half and all of the layer's height
+			const float top = height * std::uniform_real_distribution<float>(0.0f, 0.5f)(rng);
+			draw_wrapped_circle(x(rng), top + r, r, color);
+		}
+		EndTextureMode();
+		return layer;
+	}
+public:
+	Background() {
+		// the same scenery every run
+		Rng rng(0x5ca1ab1e);
+
+		layers_[0] = begin_layer(0.0f, SCREEN_HEIGHT, 0.0f);
+		DrawRectangleGradientV(0, 0, LAYER_WIDTH, SCREEN_HEIGHT, Color{110, 170, 230, 255}, Color{225, 240, 250, 255});
+		EndTextureMode();
+
+		layers_[1] = make_hills(rng, 220.0f, 0.15f, 9, 140.0f, 260.0f, Color{150, 185, 200, 255});
+
+		layers_[2] = begin_layer(20.0f, 200.0f, 0.3f);
+		std::uniform_real_distribution<float> x(0.0f, LAYER_WIDTH);
+		std::uniform_real_distribution<float> y(40.0f, 150.0f);
+		std::uniform_real_distribution<float> puff(-40.0f, 40.0f);
+		std::uniform_real_distribution<float> radius(18.0f, 34.0f);
+		for (int i = 0; i < 7; ++i) {
+			const float cx = x(rng);
+			const float cy = y(rng);
+			for (int p = 0; p < 5; ++p) {
+				draw_wrapped_circle(cx + puff(rng), cy + puff(rng) / 3.0f, radius(rng), Color{255, 255, 255, 230});
+			}
+		}
+		EndTextureMode();
+
+		layers_[3] = make_hills(rng, 140.0f, 0.5f, 12, 70.0f, 140.0f, Color{120, 180, 110, 255});
+	}
+
+	~Background() {
+		for (Layer &layer : layers_) {
+			UnloadRenderTexture(layer.texture);
+		}
+	}
+
+	Background(const Background&) = delete;
+	Background& operator=(const Background&) = delete;
+
+	// Fills the whole field, so it replaces clearing the frame.
+	void render(float camera_x) {
+		for (const Layer &layer : layers_) {
+			const float u = std::fmod(camera_x * layer.rate, static_cast<float>(LAYER_WIDTH));
+			// render textures are stored upside down
+			const Rectangle source = { u, 0.0f, static_cast<float>(SCREEN_WIDTH), -layer.height };
+			const Rectangle dest = { 0.0f, layer.y, static_cast<float>(SCREEN_WIDTH), layer.height };
+			DrawTexturePro(layer.texture.texture, source, dest, Vector2{0.0f, 0.0f}, 0.0f, WHITE);
+		}
+	}
+};//~ Background
+
+// Key presses, stamped with the frame that polled them.
+class KeyboardInput final : public InputSource {
+public:
+	void poll(double now, const InputView &, InputQueue &queue) override {
+		if (IsKeyPressed(KEY_SPACE)) {
+			queue.push(InputEvent{now, Action::Flap});
+		}
+		if (IsKeyPressed(KEY_P)) {
+			queue.push(InputEvent{now, Action::Play});
+		}
+		if (IsKeyPressed(KEY_Q)) {
+			queue.push(InputEvent{now, Action::Quit});
+		}
+	}
+};//~ KeyboardInput
+
+// The first gamepad: the bottom face button flaps, start plays, back quits.
+class GamepadInput final : public InputSource {
+public:
+	void poll(double now, const InputView &, InputQueue &queue) override {
+		if (!IsGamepadAvailable(0)) {
+			return;
+		}
+		if (IsGamepadButtonPressed(0, GAMEPAD_BUTTON_RIGHT_FACE_DOWN)) {
+			queue.push(InputEvent{now, Action::Flap});
+		}
+		if (IsGamepadButtonPressed(0, GAMEPAD_BUTTON_MIDDLE_RIGHT)) {
+			queue.push(InputEvent{now, Action::Play});
+		}
+		if (IsGamepadButtonPressed(0, GAMEPAD_BUTTON_MIDDLE_LEFT)) {
+			queue.push(InputEvent{now, Action::Quit});
+		}
+	}
+};//~ GamepadInput
+
 class State final {
 private:
 	GameMode mode_ = GameMode::Menu;
-	Player player_{5, SCREEN_HEIGHT / 2};
-	Obstacle obstacle_ = Obstacle::create(SCREEN_WIDTH, 0);
+	std::uint32_t seed_ = 0;
+	Rng rng_{seed_};
+	Player player_{PLAYER_START_X, SCREEN_HEIGHT / 2};
+	Obstacle obstacle_ = Obstacle::create(SCREEN_WIDTH, 0, rng_);
 	int score_ = 0;
-	bool can_flap_ = true;
+	// ticks into the current game; the ghosts are shown at the same tick
+	std::uint32_t episode_ticks_ = 0;
+	Ghosts *ghosts_ = nullptr;
+	std::optional<std::uint32_t> fixed_seed_;
+	FrameStream *stream_ = nullptr;
+	StateStream *broadcast_ = nullptr;
+	bool new_episode_ = false;
+	RulesWatcher *rules_ = nullptr;
+
+	static constexpr Rules DEFAULT_RULES{};
+
+	// The compile-time rules unless a rules file is watched.
+	const Rules &rules() { return rules_ ? rules_->current() : DEFAULT_RULES; }
+
+	// Input is consumed on the game clock: wall time when played live, or one
+	// SIM_DT per frame in fixed-step runs, which makes them deterministic.
+	std::vector<InputSource *> sources_;
+	InputQueue input_;
+	bool fixed_step_ = false;
+	std::uint64_t tick_ = 0;
+
+	// Moving averages of the time from a flap to the tick that applied it and
+	// to the end of the frame that showed it, in seconds.
+	static constexpr double LATENCY_SMOOTHING = 0.125;
+	bool show_latency_ = false;
+	double latency_sim_ = 0.0;
+	double latency_screen_ = 0.0;
+	// the first flap of the frame being drawn
+	std::optional<double> shown_flap_;
+
+	// Flap, score and death effects. Particles live in game coordinates and
+	// are drawn as quads into a render batch of their own, so the whole pool
+	// goes out in one draw call.
+	static constexpr int PARTICLE_CAPACITY = 65536;
+	static constexpr float PARTICLE_GRAVITY = 400.0f;
+	static constexpr Burst FEATHERS = { 12, 160.0f, 40.0f, 40.0f, 140.0f, 0.3f, 0.6f, 4.0f, 0xff3c82e6u };
+	static constexpr Burst SPARKS = { 48, 0.0f, 180.0f, 80.0f, 260.0f, 0.3f, 0.7f, 3.0f, 0xff00c8ffu };
+	static constexpr Burst EXPLOSION = { 800, 0.0f, 180.0f, 40.0f, 520.0f, 0.5f, 1.6f, 3.0f, 0xff2030e6u };
+	PageBlock particle_block_{Particles::memory_needed(PARTICLE_CAPACITY)};
+	Arena particle_arena_{particle_block_};
+	Particles particles_{particle_arena_, PARTICLE_CAPACITY};
+	RenderBatch particle_batch_ = rlLoadRenderBatch(1, PARTICLE_CAPACITY);
+	// effects draw from their own engine, never the obstacle stream's
+	Rng effects_rng_{std::random_device{}()};
+	// where the last play frame was drawn from
+	float camera_x_ = 0.0f;
+	Background background_;
+
+	// Play runs in fixed SIM_DT ticks whatever the frame rate, and frames draw
+	// the bird interpolated between the last two ticks.
+	static constexpr int MAX_TICKS_PER_FRAME = 8;
+	// end of the last tick on the game clock
+	double sim_time_ = 0.0;
+	Vector2 prev_pos_{0.0f, 0.0f};
+
+	double now() const { return fixed_step_ ? tick_time(tick_) : GetTime(); }
+
+	// Play and quit as the menus take them; flaps are dropped.
+	void menu_input() {
+		InputEvent event;
+		while (input_.pop(now(), event)) {
+			if (event.action == Action::Play) {
+				restart();
+			} else if (event.action == Action::Quit) {
+				mode_ = GameMode::Quitting;
+			}
+		}
+	}
 
 	static constexpr const char *WELCOME_TEXT = "Welcome to Flappy Dragon";
 	static constexpr const char *FLAP_TEXT = "Press SPACE to flap";
@@ -143,39 +610,216 @@ private:
 		static auto len = MeasureTextEx(FONT, YOU_ARE_DEAD_TEXT, FONT.baseSize, 2);
 		return len;
 	}
+
+	// Seconds since the last frame, for effects only; a stall skips ahead.
+	float effects_dt() const { return fixed_step_ ? SIM_DT : std::min(GetFrameTime(), 0.1f); }
+
+	void draw_particles(float camera_x) {
+		const int n = particles_.count();
+		if (n == 0) {
+			return;
+		}
+		const float *px = particles_.x();
+		const float *py = particles_.y();
+		const float *size = particles_.size();
+		const std::uint32_t *color = particles_.color();
+		rlSetRenderBatchActive(&particle_batch_);
+		rlBegin(RL_QUADS);
+		for (int i = 0; i < n; ++i) {
+			const float x = px[i] - camera_x;
+			const float y = py[i];
+			const float h = size[i] / 2.0f;
+			const std::uint32_t c = color[i];
+			rlColor4ub(c & 0xff, (c >> 8) & 0xff, (c >> 16) & 0xff,
+				static_cast<unsigned char>((c >> 24) * particles_.fade(i)));
+			rlVertex2f(x - h, y - h);
+			rlVertex2f(x - h, y + h);
+			rlVertex2f(x + h, y + h);
+			rlVertex2f(x + h, y - h);
+		}
+		rlEnd();
+		// draws the particle batch and goes back to raylib's own
+		rlSetRenderBatchActive(nullptr);
+	}
+
+	void draw_dead_text() {
+		auto dtl = dead_text_len();
+		Vector2 loc = { (SCREEN_WIDTH - dtl.x) / 2, SCREEN_HEIGHT / 3.0};
+		DrawTextEx(FONT, YOU_ARE_DEAD_TEXT, loc, FONT.baseSize, 2, TEXT_COLOR);
+
+		loc.y += dtl.y;
+		DrawTextEx(FONT, PLAY_AGAIN, loc, FONT.baseSize, 2, TEXT_COLOR);
+
+		loc.y += dtl.y;
+		DrawTextEx(FONT, QUIT_GAME, loc, FONT.baseSize, 2, TEXT_COLOR);
+	}
 public:
 	State() = default;
+	~State() { rlUnloadRenderBatch(particle_batch_); }
 	State(const State&) = delete;
 	State& operator=(const State&) = delete;
 
 	GameMode mode() const { return mode_; }
 
+	// Every game is played on the ghosts' seed from now on.
+	void race(Ghosts *ghosts) { ghosts_ = ghosts; }
+
+	// Plays by the rules of a watched file, picking up its changes live.
+	void tune(RulesWatcher *rules) { rules_ = rules; }
+
+	// Every game is played on `seed`, unless racing ghosts.
+	void fix_seed(std::uint32_t seed) { fixed_seed_ = seed; }
+
+	void add_input(InputSource *source) { sources_.push_back(source); }
+
+	// Runs exactly one tick per frame, on a clock that advances SIM_DT a frame.
+	void use_fixed_step() { fixed_step_ = true; }
+
+	// Shows input latency in the HUD; only meaningful for timestamped input.
+	void show_latency() { show_latency_ = true; }
+
+	// Collects this frame's input; call once per frame before the mode's handler.
+	void poll_input() {
+		const InputView view = { mode_ == GameMode::Playing, player_.pos.y, player_.vel.y,
+			static_cast<float>(obstacle_.gap) };
+		for (InputSource *source : sources_) {
+			source->poll(now(), view, input_);
+		}
+	}
+
+	// Advances the fixed-step clock; call once per frame after the handler.
+	void end_tick() { tick_ += 1; }
+
+	// Spectators get the play screen redrawn by the CPU rasterizer, so nothing
+	// is read back from the GPU; menus leave them on the last frame.
+	void stream(FrameStream *stream) { stream_ = stream; }
+
+	// Spectators that draw for themselves get the game's state as game 0.
+	void broadcast(StateStream *broadcast) { broadcast_ = broadcast; }
+
 	void on_main_menu() {
-		BeginDrawing();
-		ClearBackground(WHITE);
+		if (PRESENTER.begin_static_frame(static_cast<int>(GameMode::Menu))) {
+			ClearBackground(WHITE);
 
-		auto wtl = welcome_text_len();
-		float xloc = (SCREEN_WIDTH - wtl.x) / 2.0;
-		Vector2 fpos = { xloc, SCREEN_HEIGHT / 3.0 };
-		DrawTextEx(FONT, WELCOME_TEXT, fpos, FONT.baseSize, 2, TEXT_COLOR);
+			auto wtl = welcome_text_len();
+			float xloc = (SCREEN_WIDTH - wtl.x) / 2.0;
+			Vector2 fpos = { xloc, SCREEN_HEIGHT / 3.0 };
+			DrawTextEx(FONT, WELCOME_TEXT, fpos, FONT.baseSize, 2, TEXT_COLOR);
 
-		fpos.y += wtl.y;
-		DrawTextEx(FONT, PLAY_GAME   , fpos, FONT.baseSize, 2, TEXT_COLOR);
+			fpos.y += wtl.y;
+			DrawTextEx(FONT, PLAY_GAME   , fpos, FONT.baseSize, 2, TEXT_COLOR);
 
-		fpos.y += wtl.y;
-		DrawTextEx(FONT, QUIT_GAME   , fpos, FONT.baseSize, 2, TEXT_COLOR);
-		EndDrawing();
+			fpos.y += wtl.y;
+			DrawTextEx(FONT, QUIT_GAME   , fpos, FONT.baseSize, 2, TEXT_COLOR);
+		}
+		PRESENTER.end_frame();
+		if (stream_) {
+			stream_->publish();
+		}
+		if (broadcast_) {
+			broadcast_->flush();
+		}
 
-		if (IsKeyDown(KEY_P)) {
-			restart();
-		} else if (IsKeyDown(KEY_Q)) {
-			mode_ = GameMode::Quitting;
-		}	
+		menu_input();
 	}
 
+	// One SIM_DT step of play, spanning (tick_end - SIM_DT, tick_end] on the
+	// game clock. A precisely stamped flap lands at its own time inside that
+	// span, clamped to it: with evdev input the bird reacts mid-tick instead of
+	// at the next tick edge. Keyboard and gamepad presses are only known to
+	// the frame that polled them, so they land at the start of the tick.
+	// Fixed-step events fall on the end edge, which keeps scripted runs exact.
+	void tick(double tick_end) {
+		const Rules &rules = this->rules();
+		prev_pos_ = player_.pos;
+		episode_ticks_ += 1;
+		const double tick_start = tick_end - SIM_DT;
+		float simulated = 0.0f;
+		// at most one flap per tick, the same as the headless simulation
+		bool flapped = false;
+		InputEvent event;
+		while (input_.pop(tick_end, event)) {
+			if (event.action == Action::Flap && !flapped) {
+				const float at = fixed_step_ ? SIM_DT : !event.precise ? 0.0f
+					: std::clamp(static_cast<float>(event.time - tick_start), 0.0f, SIM_DT);
+				if (at > simulated) {
+					player_.physics(at - simulated, rules);
+					simulated = at;
+				}
+				player_.flap(rules);
+				particles_.emit(FEATHERS, player_.pos.x + PLAYER_RADIUS, player_.pos.y, rules.horizontal_velocity, 0.0f,
+					effects_rng_);
+				flapped = true;
+				if (!shown_flap_) {
+					shown_flap_ = event.time;
+				}
+				// a flap older than the tick lands at its start
+				const double applied = tick_start + at;
+				latency_sim_ += (std::max(applied - event.time, 0.0) - latency_sim_) * LATENCY_SMOOTHING;
+			} else if (event.action == Action::Quit) {
+				mode_ = GameMode::Quitting;
+			}
+		}
+		if (simulated < SIM_DT) {
+			player_.physics(SIM_DT - simulated, rules);
+		}
+
+		// spectators follow the ticks, not the local frame rate
+		if (stream_) {
+			draw_scene(stream_->canvas(), SceneState{player_.pos.y, obstacle_.x - player_.pos.x,
+				static_cast<float>(obstacle_.gap), score_, static_cast<float>(obstacle_.size)});
+			stream_->publish();
+		}
+		if (broadcast_) {
+			broadcast_->update(0, SpectatorState{player_.pos.y, player_.vel.y,
+				obstacle_.x - player_.pos.x, static_cast<float>(obstacle_.gap), score_}, new_episode_);
+			broadcast_->flush();
+			new_episode_ = false;
+		}
+
+		if (mode_ == GameMode::Quitting) {
+			return;
+		}
+		if (player_.pos.y > SCREEN_HEIGHT || obstacle_.is_hit(player_)) {
+			mode_ = GameMode::End;
+			particles_.emit(EXPLOSION, player_.pos.x + PLAYER_RADIUS, player_.pos.y, 0.0f, 0.0f, effects_rng_);
+		} else if (player_.pos.x > obstacle_.x) {
+			particles_.emit(SPARKS, obstacle_.x + OBSTACLE_WIDTH / 2.0f, obstacle_.gap, 0.0f, 0.0f, effects_rng_);
+			score_ += 1;
+			obstacle_ = Obstacle::create(player_.pos.x + SCREEN_WIDTH, score_, rng_, rules);
+		}
+	}
+
+	// Runs the ticks due by now, then draws the bird between the last two,
+	// so the frame rate can be anything without changing the game's speed.
 	void on_play() {
-		BeginDrawing();
-		ClearBackground(WHITE);
+		const double frame_end = now();
+		float alpha = 1.0f;
+		if (fixed_step_) {
+			tick(frame_end);
+		} else {
+			int ticks = 0;
+			while (mode_ == GameMode::Playing && sim_time_ + SIM_DT <= frame_end) {
+				if (ticks == MAX_TICKS_PER_FRAME) {
+					// after a stall, drop the time instead of racing to catch up
+					sim_time_ = frame_end;
+					break;
+				}
+				tick(sim_time_ + SIM_DT);
+				sim_time_ += SIM_DT;
+				ticks += 1;
+			}
+			if (mode_ == GameMode::Playing) {
+				alpha = std::clamp(static_cast<float>((frame_end - sim_time_) / SIM_DT), 0.0f, 1.0f);
+			}
+		}
+		const float x = prev_pos_.x + (player_.pos.x - prev_pos_.x) * alpha;
+		const float y = prev_pos_.y + (player_.pos.y - prev_pos_.y) * alpha;
+		camera_x_ = x;
+		particles_.update(effects_dt(), PARTICLE_GRAVITY);
+
+		PRESENTER.begin_frame();
+		background_.render(x);
 
 		auto ftl = flap_text_len();
 		Vector2 fpos = { 10.0, 10.0 };
@@ -187,67 +831,407 @@ public:
 		fpos.y += ftl.y;
 		DrawTextEx(FONT, score_buffer, fpos, FONT.baseSize, 2, TEXT_COLOR);
 
-		auto frame_time = GetFrameTime();
-		player_.physics(frame_time);
-		if (can_flap_ && IsKeyDown(KEY_SPACE)) {
-			player_.flap();
-			can_flap_ = false;
+		if (show_latency_) {
+			static char latency_buffer[128];
+			sprintf(latency_buffer, "Input: %.1f ms to sim, %.1f ms to screen", latency_sim_ * 1000.0,
+				latency_screen_ * 1000.0);
+			fpos.y += ftl.y;
+			DrawTextEx(FONT, latency_buffer, fpos, FONT.baseSize, 2, TEXT_COLOR);
 		}
-		if (!can_flap_ && IsKeyUp(KEY_SPACE)) {
-			can_flap_ = true;
-		}
-		player_.render();
-		obstacle_.render(player_.pos.x);
-		EndDrawing();
 
-		if (player_.pos.y > SCREEN_HEIGHT || obstacle_.is_hit(player_)) {
-			mode_ = GameMode::End;
-		} else if (player_.pos.x > obstacle_.x) {
-			score_ += 1;
-			obstacle_ = Obstacle::create(player_.pos.x + SCREEN_WIDTH, score_);
+		if (ghosts_) {
+			ghosts_->render(episode_ticks_ == 0 ? 0.0f : episode_ticks_ - 1 + alpha);
+		}
+		player_.render(y);
+		obstacle_.render(x);
+		draw_particles(x);
+		PRESENTER.end_frame();
+		if (shown_flap_) {
+			if (!fixed_step_) {
+				latency_screen_ += (GetTime() - *shown_flap_ - latency_screen_) * LATENCY_SMOOTHING;
+			}
+			shown_flap_.reset();
 		}
 	}
 
+	// The explosion plays out over the frozen scene; after that the screen is
+	// static again.
 	void on_died() {
-		BeginDrawing();
-		ClearBackground(WHITE);
+		if (particles_.count() != 0) {
+			particles_.update(effects_dt(), PARTICLE_GRAVITY);
+			PRESENTER.begin_frame();
+			background_.render(camera_x_);
+			obstacle_.render(camera_x_);
+			draw_particles(camera_x_);
+			draw_dead_text();
+		} else if (PRESENTER.begin_static_frame(static_cast<int>(GameMode::End))) {
+			background_.render(camera_x_);
+			obstacle_.render(camera_x_);
+			draw_dead_text();
+		}
+		PRESENTER.end_frame();
+		if (stream_) {
+			stream_->publish();
+		}
+		if (broadcast_) {
+			broadcast_->flush();
+		}
 
-		auto dtl = dead_text_len();
-		Vector2 loc = { (SCREEN_WIDTH - dtl.x) / 2, SCREEN_HEIGHT / 3.0};
-		DrawTextEx(FONT, YOU_ARE_DEAD_TEXT, loc, FONT.baseSize, 2, TEXT_COLOR);
+		menu_input();
+	}
 
-		loc.y += dtl.y;
-		DrawTextEx(FONT, PLAY_AGAIN, loc, FONT.baseSize, 2, TEXT_COLOR);
+	void restart() {
+		static std::random_device r;
+		restart(ghosts_ ? ghosts_->seed() : fixed_seed_ ? *fixed_seed_ : r());
+	}
 
-		loc.y += dtl.y;
-		DrawTextEx(FONT, QUIT_GAME, loc, FONT.baseSize, 2, TEXT_COLOR);
-		EndDrawing();
+	void restart(std::uint32_t seed) {
+		mode_ = GameMode::Playing;
+		seed_ = seed;
+		rng_.seed(seed_);
+		player_ = Player(PLAYER_START_X, SCREEN_HEIGHT / 2.0);
+		prev_pos_ = player_.pos;
+		sim_time_ = now();
+		obstacle_ = Obstacle::create(SCREEN_WIDTH, 0, rng_, rules());
+		score_ = 0;
+		episode_ticks_ = 0;
+		new_episode_ = true;
+		particles_.clear();
+	}
+};//~ State
+
+// Thousands of bot-controlled birds flying through one obstacle stream. The
+// birds are the lanes of an EnvBatch whose episodes all share one seed, and
+// every bird is the same cached sprite drawn with its own tint, so raylib's
+// batcher merges the whole crowd into one draw call per 8192 birds.
+class Crowd final {
+private:
+	static constexpr int MAX_STEPS_PER_FRAME = 4;
+	static constexpr float MIN_OFFSET = 20.0;
+	static constexpr float MAX_OFFSET = 85.0;
+
+	int size_;
+	PageBlock block_;
+	Arena arena_;
+	std::optional<EnvBatch> batch_;
+	std::uint8_t *flap_ = nullptr;
+	std::vector<float> offset_;
+	std::vector<Color> color_;
+	RenderTexture2D sprite_;
+	Background background_;
+	Rng rng_{std::random_device{}()};
+	float accumulator_ = 0.0;
+	bool quit_ = false;
+
+	static EnvOptions options(int size, std::uint32_t seed) {
+		EnvOptions opt;
+		opt.first_seed = seed;
+		opt.seed_stride = 0;
+		opt.episodes = size;
+		opt.slot_arena_bytes = 0;
+		return opt;
+	}
+
+	void restart() {
+		arena_.reset();
+		batch_.emplace(size_, arena_, options(size_, rng_()));
+		flap_ = arena_.make_array<std::uint8_t>(size_);
+		std::uniform_real_distribution<float> u(MIN_OFFSET, MAX_OFFSET);
+		for (float &offset : offset_) {
+			offset = u(rng_);
+		}
+		accumulator_ = 0.0;
+	}
+public:
+	explicit Crowd(int size)
+		: size_(size),
+		  block_(EnvBatch::memory_needed(size, options(size, 0)) + size + Arena::CACHE_LINE),
+		  arena_(block_), offset_(size), color_(size) {
+		for (int i = 0; i < size_; ++i) {
+			color_[i] = Fade(ColorFromHSV(360.0f * i / size_, 0.8f, 0.9f), 0.8f);
+		}
+		sprite_ = load_bird_sprite();
+		restart();
+	}
+
+	~Crowd() {
+		UnloadRenderTexture(sprite_);
+	}
+
+	Crowd(const Crowd&) = delete;
+	Crowd& operator=(const Crowd&) = delete;
 
-		if (IsKeyDown(KEY_P)) {
+	bool quitting() const { return quit_; }
+
+	void on_frame() {
+		EnvBatch &batch = *batch_;
+		accumulator_ += GetFrameTime();
+		for (int i = 0; i < MAX_STEPS_PER_FRAME && accumulator_ >= SIM_DT; ++i) {
+			heuristic_bot(batch, flap_, offset_.data());
+			batch.step(flap_);
+			accumulator_ -= SIM_DT;
+		}
+		if (accumulator_ > SIM_DT) {
+			accumulator_ = 0.0;
+		}
+
+		// Every surviving bird has flown as far and met the same pipes, so any
+		// one of them shows where the crowd is. Dead lanes wait for compaction
+		// with a stale pipe and score.
+		const std::uint32_t *alive = batch.alive();
+		const int lead = std::find(alive, alive + batch.live(), 1u) - alive;
+		const bool flying = lead != batch.live();
+
+		PRESENTER.begin_frame();
+		background_.render(flying ? batch.x()[lead] : 0.0f);
+		if (flying) {
+			Obstacle(batch.obstacle_x()[lead], batch.gap()[lead], GAP_SIZE).render(batch.x()[lead]);
+		}
+		const float *y = batch.y();
+		const std::uint32_t *env = batch.lane_env();
+		for (int i = 0; i < batch.live(); ++i) {
+			if (alive[i]) {
+				DrawTextureV(sprite_.texture, Vector2{0.0f, y[i] - PLAYER_RADIUS}, color_[env[i]]);
+			}
+		}
+
+		static char status_buffer[128];
+		sprintf(status_buffer, "Alive: %d / %d   Score: %d", batch.active(), size_,
+			flying ? batch.score()[lead] : 0);
+		DrawTextEx(FONT, status_buffer, Vector2{10.0, 10.0}, FONT.baseSize, 2, TEXT_COLOR);
+		DrawFPS(SCREEN_WIDTH - 90, 10);
+		PRESENTER.end_frame();
+
+		if (batch.active() == 0) {
 			restart();
-		} else if (IsKeyDown(KEY_Q)) {
-			mode_ = GameMode::Quitting;
+		}
+		if (IsKeyDown(KEY_Q)) {
+			quit_ = true;
 		}
 	}
+};//~ Crowd
 
-	void restart() {
-		mode_ = GameMode::Playing;
-		player_ = Player(5, SCREEN_HEIGHT / 2.0);
-		obstacle_ = Obstacle::create(SCREEN_WIDTH, 0);
-		score_ = 0;
+// Scaled-down copies of many headless games tiled into the window. A
+// simulation thread steps the games as fast as it can and hands a snapshot
+// to the render thread only when one is asked for, so watching costs the
+// simulation one small copy per displayed frame.
+class Monitor final {
+private:
+	static constexpr int MAX_GRID = 16;
+	static constexpr int MAX_TILES = MAX_GRID * MAX_GRID;
+	static constexpr Color TILE_BACKGROUND = { 245, 245, 245, 255 };
+
+	struct Snapshot {
+		std::uint64_t steps = 0;
+		std::uint64_t episodes = 0;
+		float y[MAX_TILES];
+		float pipe_x[MAX_TILES];
+		float gap[MAX_TILES];
+	};
+
+	struct TileRect {
+		Rectangle rect;
+		Color color;
+	};
+
+	int grid_;
+	int tiles_;
+	TripleBuffer<Snapshot> snapshots_;
+	std::atomic<bool> wanted_{true};
+	std::atomic<bool> stop_{false};
+	std::thread sim_;
+	RenderTexture2D sprite_;
+	std::vector<TileRect> rects_;
+	std::vector<Vector2> birds_;
+	std::uint64_t last_steps_ = 0;
+	double last_time_ = 0.0;
+	double steps_per_second_ = 0.0;
+	bool quit_ = false;
+
+	void simulate() {
+		EnvOptions opt;
+		opt.first_seed = std::random_device{}();
+		opt.slot_arena_bytes = 0;
+		PageBlock block(EnvBatch::memory_needed(tiles_, opt) + tiles_ * (1 + sizeof(float)) + 2 * Arena::CACHE_LINE);
+		Arena arena(block);
+		EnvBatch batch(tiles_, arena, opt);
+		std::uint8_t *flap = arena.make_array<std::uint8_t>(tiles_);
+		float *offset = arena.make_array<float>(tiles_);
+		Rng rng(opt.first_seed);
+		std::uniform_real_distribution<float> u(20.0f, 85.0f);
+		for (int i = 0; i < tiles_; ++i) {
+			offset[i] = u(rng);
+		}
+
+		std::uint64_t steps = 0;
+		std::uint64_t episodes = 0;
+		while (!stop_.load(std::memory_order_relaxed)) {
+			heuristic_bot(batch, flap, offset);
+			batch.step(flap);
+			batch.prepare_resets();
+			steps += batch.live();
+			episodes += batch.finished_count();
+
+			if (wanted_.load(std::memory_order_relaxed)) {
+				Snapshot &snap = snapshots_.write_slot();
+				snap.steps = steps;
+				snap.episodes = episodes;
+				for (int i = 0; i < batch.live(); ++i) {
+					const std::uint32_t env = batch.lane_env()[i];
+					snap.y[env] = batch.y()[i];
+					snap.pipe_x[env] = batch.obstacle_x()[i] - batch.x()[i];
+					snap.gap[env] = batch.gap()[i];
+				}
+				snapshots_.publish();
+				wanted_.store(false, std::memory_order_relaxed);
+			}
+		}
 	}
-};//~ State
 
-int main() {
-	SetTargetFPS(60);
-	InitWindow(SCREEN_WIDTH, SCREEN_HEIGHT, "Flappy Dragon");
+	// Clips a rectangle in game coordinates to the screen and places it in
+	// the tile, so all tiles go into one batch without scissor changes.
+	void add_rect(float x, float y, float w, float h, Vector2 origin, float scale, Color color) {
+		const float x0 = std::max(x, 0.0f);
+		const float y0 = std::max(y, 0.0f);
+		const float x1 = std::min(x + w, static_cast<float>(SCREEN_WIDTH));
+		const float y1 = std::min(y + h, static_cast<float>(SCREEN_HEIGHT));
+		if (x1 > x0 && y1 > y0) {
+			rects_.push_back(TileRect{
+				Rectangle{origin.x + x0 * scale, origin.y + y0 * scale, (x1 - x0) * scale, (y1 - y0) * scale}, color});
+		}
+	}
+public:
+	explicit Monitor(int grid) : grid_(std::clamp(grid, 1, MAX_GRID)), tiles_(grid_ * grid_) {
+		sprite_ = load_bird_sprite();
+		rects_.reserve(tiles_ * 4);
+		birds_.reserve(tiles_);
+		sim_ = std::thread(&Monitor::simulate, this);
+	}
 
-	FONT = LoadFont("../resources/pixantiqua.fnt");
+	~Monitor() {
+		stop_ = true;
+		sim_.join();
+		UnloadRenderTexture(sprite_);
+	}
+
+	Monitor(const Monitor&) = delete;
+	Monitor& operator=(const Monitor&) = delete;
+
+	bool quitting() const { return quit_; }
+
+	void on_frame() {
+		const Snapshot &snap = snapshots_.read();
+		wanted_.store(true, std::memory_order_relaxed);
+
+		const double now = GetTime();
+		if (now - last_time_ >= 1.0) {
+			steps_per_second_ = (snap.steps - last_steps_) / (now - last_time_);
+			last_steps_ = snap.steps;
+			last_time_ = now;
+		}
+
+		// build the whole frame as two flat lists: shapes, then birds
+		const float tile_w = static_cast<float>(SCREEN_WIDTH) / grid_;
+		const float tile_h = static_cast<float>(SCREEN_HEIGHT) / grid_;
+		const float scale = 1.0f / grid_;
+		const float half_gap = GAP_SIZE / 2.0f;
+		rects_.clear();
+		birds_.clear();
+		for (int t = 0; t < tiles_; ++t) {
+			const Vector2 origin = { (t % grid_) * tile_w, (t / grid_) * tile_h };
+			rects_.push_back(TileRect{Rectangle{origin.x, origin.y, tile_w - 1.0f, tile_h - 1.0f}, TILE_BACKGROUND});
+			add_rect(snap.pipe_x[t], 0.0f, OBSTACLE_WIDTH, snap.gap[t] - half_gap, origin, scale, BLUE);
+			add_rect(snap.pipe_x[t], snap.gap[t] + half_gap, OBSTACLE_WIDTH, SCREEN_HEIGHT - snap.gap[t] - half_gap,
+				origin, scale, BLUE);
+			add_rect(0.0f, SCREEN_HEIGHT - GROUND_HEIGHT, SCREEN_WIDTH, GROUND_HEIGHT, origin, scale, DARKGREEN);
+			birds_.push_back(Vector2{origin.x, origin.y + (snap.y[t] - PLAYER_RADIUS) * scale});
+		}
 
+		PRESENTER.begin_frame();
+		ClearBackground(GRAY);
+		for (const TileRect &r : rects_) {
+			DrawRectangleRec(r.rect, r.color);
+		}
+		for (const Vector2 &pos : birds_) {
+			DrawTextureEx(sprite_.texture, pos, 0.0f, scale, RED);
+		}
+
+		static char status_buffer[128];
+		sprintf(status_buffer, "%d games, %.2f M steps/s, %llu episodes", tiles_, steps_per_second_ / 1e6,
+			static_cast<unsigned long long>(snap.episodes));
+		DrawTextEx(FONT, status_buffer, Vector2{10.0, SCREEN_HEIGHT - 30.0}, FONT.baseSize, 2, TEXT_COLOR);
+		PRESENTER.end_frame();
+
+		if (IsKeyDown(KEY_Q)) {
+			quit_ = true;
+		}
+	}
+};//~ Monitor
+
+static constexpr const char *MODE_NAMES[] = { "menu", "play", "died", "quit" };
+
+static void run_crowd(int size) {
+	Crowd crowd(size);
+	while (!WindowShouldClose() && !crowd.quitting()) {
+		crowd.on_frame();
+	}
+}
+
+static void run_monitor(int grid) {
+	Monitor monitor(grid);
+	while (!WindowShouldClose() && !monitor.quitting()) {
+		monitor.on_frame();
+	}
+}
+
+// Returns the number of steady-state play frames that allocated. A scripted
+// `script` plays in fixed steps as fast as the machine allows and reports
+// the frame rate it got; the keyboard still quits it. `evdev`, if given,
+// takes the place of the GLFW keyboard and gamepad.
+static int run_game(Ghosts *ghosts, FrameStream *stream, StateStream *broadcast,
+	EvdevInput *evdev, InputSource *script, std::optional<std::uint32_t> seed, RulesWatcher *rules) {
 	State state;
+	state.race(ghosts);
+	state.tune(rules);
+	state.stream(stream);
+	state.broadcast(broadcast);
+	if (seed) {
+		state.fix_seed(*seed);
+	}
+	// evdev sees the same keys as GLFW, so it replaces both
+	KeyboardInput keyboard;
+	GamepadInput gamepad;
+	if (evdev) {
+		state.add_input(evdev);
+		state.show_latency();
+	} else {
+		state.add_input(&keyboard);
+		state.add_input(&gamepad);
+	}
+	if (script) {
+		state.add_input(script);
+	}
+	const bool scripted = script && script->scripted();
+	if (scripted) {
+		state.use_fixed_step();
+		PRESENTER.set_idle_sleep(false);
+		SetTargetFPS(0);
+	}
+	const double start = GetTime();
+	long frames = 0;
 	bool quit = false;
+	GameMode last_mode = state.mode();
+	int frames_in_mode = 0;
+	int allocating_frames = 0;
 	while (!WindowShouldClose() && !quit) {
-		switch (state.mode()) {
+		const GameMode mode = state.mode();
+		frames_in_mode = mode == last_mode ? frames_in_mode + 1 : 0;
+		last_mode = mode;
+
+		alloc_tracker::set_tag(static_cast<int>(mode));
+		const auto allocs_before = alloc_tracker::thread_counts();
+		state.poll_input();
+		switch (mode) {
 		case GameMode::Menu:
 			state.on_main_menu();
 			break;
@@ -262,8 +1246,185 @@ int main() {
 		default:
 			break;
 		}
+
+		// the first frame after a mode switch is allowed to warm up
+		const auto allocs = alloc_tracker::thread_counts() - allocs_before;
+		if (allocs.calls != 0 && mode == GameMode::Playing && frames_in_mode > 0) {
+			TraceLog(LOG_WARNING, "ALLOC: steady-state play frame made %zu allocations (%zu bytes)",
+				allocs.calls, allocs.bytes);
+			allocating_frames += 1;
+		}
+		state.end_tick();
+		frames += 1;
+	}
+	if (scripted) {
+		const double seconds = GetTime() - start;
+		TraceLog(LOG_INFO, "scripted run: %ld frames in %.2f s, %.1f FPS", frames, seconds,
+			seconds > 0.0 ? frames / seconds : 0.0);
+	}
+	return allocating_frames;
+}
+
+int main(int argc, char **argv) {
+	int crowd_size = 0;
+	int monitor_grid = 0;
+	const char *ghost_dir = nullptr;
+	int ghost_count = 100;
+	std::optional<std::uint32_t> ghost_seed;
+	float render_scale = 0.0f;
+	int stream_port = 0;
+	int broadcast_port = 0;
+	const char *script_path = nullptr;
+	const char *replay_path = nullptr;
+	int bot_games = 0;
+	bool use_evdev = false;
+	// frames per second, 0 for uncapped; follows the display when unset
+	std::optional<int> target_fps;
+	const char *rules_path = nullptr;
+	for (int i = 1; i < argc; ++i) {
+		if (std::strcmp(argv[i], "--crowd") == 0 && i + 1 < argc) {
+			crowd_size = std::atoi(argv[++i]);
+		} else if (std::strcmp(argv[i], "--monitor") == 0 && i + 1 < argc) {
+			monitor_grid = std::atoi(argv[++i]);
+		} else if (std::strcmp(argv[i], "--ghosts") == 0 && i + 1 < argc) {
+			ghost_dir = argv[++i];
+		} else if (std::strcmp(argv[i], "--ghost-count") == 0 && i + 1 < argc) {
+			ghost_count = std::atoi(argv[++i]);
+		} else if (std::strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+			ghost_seed = std::strtoul(argv[++i], nullptr, 10);
+		} else if (std::strcmp(argv[i], "--render-scale") == 0 && i + 1 < argc) {
+			render_scale = std::atof(argv[++i]);
+		} else if (std::strcmp(argv[i], "--stream") == 0 && i + 1 < argc) {
+			stream_port = std::atoi(argv[++i]);
+		} else if (std::strcmp(argv[i], "--broadcast") == 0 && i + 1 < argc) {
+			broadcast_port = std::atoi(argv[++i]);
+		} else if (std::strcmp(argv[i], "--script") == 0 && i + 1 < argc) {
+			script_path = argv[++i];
+		} else if (std::strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+			replay_path = argv[++i];
+		} else if (std::strcmp(argv[i], "--bot-play") == 0 && i + 1 < argc) {
+			bot_games = std::atoi(argv[++i]);
+		} else if (std::strcmp(argv[i], "--fps") == 0 && i + 1 < argc) {
+			target_fps = std::max(std::atoi(argv[++i]), 0);
+		} else if (std::strcmp(argv[i], "--rules") == 0 && i + 1 < argc) {
+			rules_path = argv[++i];
+		} else if (std::strcmp(argv[i], "--evdev") == 0) {
+			use_evdev = true;
+		} else {
+			TraceLog(LOG_ERROR, "usage: %s [--crowd BIRDS] [--monitor GRID] [--ghosts REPLAY_DIR [--ghost-count N]] [--seed N] [--render-scale S] [--stream PORT] [--broadcast PORT] [--script FILE | --replay FILE | --bot-play GAMES] [--evdev] [--fps N] [--rules FILE]", argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	std::vector<ReplayFile> replays;
+	if (ghost_dir) {
+		replays = load_best_replays(ghost_dir, ghost_count, ghost_seed);
+		if (replays.empty()) {
+			TraceLog(LOG_ERROR, "no replays found in %s", ghost_dir);
+			return EXIT_FAILURE;
+		}
+	}
+
+	// --seed picks the ghosts when racing them, otherwise it fixes the game
+	std::optional<std::uint32_t> game_seed = ghost_dir ? std::nullopt : ghost_seed;
+	std::unique_ptr<InputSource> script;
+	if (script_path) {
+		std::vector<InputEvent> events;
+		if (!ScriptedInput::load(script_path, events)) {
+			return EXIT_FAILURE;
+		}
+		script = std::make_unique<ScriptedInput>(std::move(events));
+	} else if (replay_path) {
+		std::vector<InputEvent> events;
+		std::uint32_t seed = 0;
+		if (!ScriptedInput::load_replay(replay_path, events, seed)) {
+			return EXIT_FAILURE;
+		}
+		script = std::make_unique<ScriptedInput>(std::move(events));
+		game_seed = seed;
+	} else if (bot_games > 0) {
+		script = std::make_unique<BotInput>(bot_games);
+	}
+	// evdev timestamps are wall time, which a fixed-step run does not follow
+	std::optional<EvdevInput> evdev;
+	if (use_evdev && !script) {
+		evdev.emplace();
+		if (!evdev->start(glfwPostEmptyEvent)) {
+			return EXIT_FAILURE;
+		}
+		TraceLog(LOG_INFO, "reading input from %d evdev devices", evdev->devices());
+	}
+
+	std::optional<RulesWatcher> rules;
+	if (rules_path) {
+		rules.emplace();
+		if (!rules->start(rules_path)) {
+			return EXIT_FAILURE;
+		}
+		TraceLog(LOG_INFO, "playing by the rules in %s, reloaded on change", rules_path);
+	}
+
+	std::optional<FrameStream> stream;
+	if (stream_port != 0) {
+		stream.emplace(SCREEN_WIDTH, SCREEN_HEIGHT);
+		if (!stream->listen(stream_port)) {
+			return EXIT_FAILURE;
+		}
+		TraceLog(LOG_INFO, "streaming to spectators on port %d", stream_port);
+	}
+	std::optional<StateStream> broadcast;
+	if (broadcast_port != 0) {
+		broadcast.emplace(1);
+		if (!broadcast->listen(broadcast_port)) {
+			return EXIT_FAILURE;
+		}
+		TraceLog(LOG_INFO, "broadcasting game state on port %d", broadcast_port);
+	}
+
+	SetConfigFlags(FLAG_WINDOW_RESIZABLE);
+	InitWindow(SCREEN_WIDTH, SCREEN_HEIGHT, "Flappy Dragon");
+	// The game ticks at 60 Hz whatever this is; frames in between only
+	// interpolate, so a 144 Hz display gets 144 smooth frames.
+	int refresh_rate = GetMonitorRefreshRate(GetCurrentMonitor());
+	if (refresh_rate <= 0) {
+		refresh_rate = 60;
+	}
+	const int fps = target_fps.value_or(refresh_rate);
+	SetTargetFPS(fps);
+	PRESENTER.set_frame_budget(1.0 / (fps > 0 ? fps : refresh_rate));
+	TraceLog(LOG_INFO, "display at %d Hz, rendering at %s", refresh_rate,
+		fps > 0 ? TextFormat("%d FPS", fps) : "uncapped FPS");
+
+	FONT = LoadFont("../resources/pixantiqua.fnt");
+	PRESENTER.load(render_scale);
+
+	int allocating_frames = 0;
+	if (crowd_size > 0) {
+		run_crowd(crowd_size);
+	} else if (monitor_grid > 0) {
+		run_monitor(monitor_grid);
+	} else if (!replays.empty()) {
+		Ghosts ghosts(std::move(replays));
+		TraceLog(LOG_INFO, "racing %d ghosts on seed %u", ghosts.count(), ghosts.seed());
+		allocating_frames = run_game(&ghosts, stream ? &*stream : nullptr, broadcast ? &*broadcast : nullptr,
+			evdev ? &*evdev : nullptr, script.get(), game_seed, rules ? &*rules : nullptr);
+	} else {
+		allocating_frames = run_game(nullptr, stream ? &*stream : nullptr, broadcast ? &*broadcast : nullptr,
+			evdev ? &*evdev : nullptr, script.get(), game_seed, rules ? &*rules : nullptr);
 	}
+
+	// its reader posts GLFW events, so it stops before GLFW does
+	evdev.reset();
+	PRESENTER.unload();
 	UnloadFont(FONT);
 	CloseWindow();
+
+	if constexpr (alloc_tracker::enabled) {
+		alloc_tracker::report(MODE_NAMES, sizeof(MODE_NAMES) / sizeof(MODE_NAMES[0]));
+		if (allocating_frames != 0) {
+			TraceLog(LOG_ERROR, "ALLOC: %d steady-state play frames allocated", allocating_frames);
+			return EXIT_FAILURE;
+		}
+	}
 	return 0;
 }
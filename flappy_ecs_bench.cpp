@@ -0,0 +1,191 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "arena.hpp"
+#include "bots.hpp"
+#include "ecs_game.hpp"
+#include "env.hpp"
+
+// Plays the same crowd of games with the hand-written EnvBatch loop and with
+// the ECS systems of ecs_game.hpp, checks that they agree and compares their
+// speed. Both extract draw rectangles every tick, as the game would.
+
+struct Options {
+	int birds = 100000;
+	long ticks = 2000;
+	int threads = static_cast<int>(std::thread::hardware_concurrency());
+	std::uint32_t seed = 1;
+	float bot_offset = 75.0f;
+	float bot_spread = 20.0f;
+	// single-episode games compared seed by seed
+	int check = 10000;
+};
+
+struct RunStats {
+	std::uint64_t steps = 0;
+	double seconds = 0.0;
+
+	double rate() const { return steps / seconds / 1e6; }
+};
+
+static std::vector<float> bot_offsets(int birds, const Options &opt) {
+	std::vector<float> offset(birds);
+	Rng rng(opt.seed);
+	std::uniform_real_distribution<float> spread(-opt.bot_spread, opt.bot_spread);
+	for (float &o : offset) {
+		o = opt.bot_offset + (opt.bot_spread > 0.0f ? spread(rng) : 0.0f);
+	}
+	return offset;
+}
+
+static void extract(const EnvBatch &batch, std::vector<DrawRect> &rects) {
+	const float half_size = batch.rules().gap_size / 2.0f;
+	rects.resize(3 * batch.live());
+	const float *x = batch.x();
+	const float *y = batch.y();
+	const float *ox = batch.obstacle_x();
+	const float *gap = batch.gap();
+	DrawRect *out = rects.data();
+	for (int i = 0; i < batch.live(); ++i) {
+		out[3 * i] = DrawRect{x[i] - PLAYER_RADIUS, y[i] - PLAYER_RADIUS, 2 * PLAYER_RADIUS, 2 * PLAYER_RADIUS};
+		out[3 * i + 1] = DrawRect{ox[i], 0.0f, OBSTACLE_WIDTH, gap[i] - half_size};
+		out[3 * i + 2] = DrawRect{ox[i], gap[i] + half_size, OBSTACLE_WIDTH, SCREEN_HEIGHT - gap[i] - half_size};
+	}
+}
+
+// Plays with EnvBatch; collects finished episodes if `results` is given.
+static RunStats run_batch(int birds, long ticks, const EnvOptions &env, const float *offset,
+	std::vector<EpisodeResult> *results) {
+	std::vector<char> memory(EnvBatch::memory_needed(birds, env) + birds + 2 * Arena::CACHE_LINE);
+	Arena arena(memory.data(), memory.size());
+	EnvBatch batch(birds, arena, env);
+	std::uint8_t *flap = arena.make_array<std::uint8_t>(birds);
+	std::vector<DrawRect> rects;
+	RunStats stats;
+	const auto start = std::chrono::steady_clock::now();
+	for (long t = 0; t < ticks && batch.live() != 0; ++t) {
+		stats.steps += batch.active();
+		heuristic_bot(batch, flap, offset);
+		batch.step(flap);
+		extract(batch, rects);
+		if (results) {
+			results->insert(results->end(), batch.finished(), batch.finished() + batch.finished_count());
+		}
+	}
+	stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return stats;
+}
+
+static RunStats run_ecs(int birds, long ticks, const EnvOptions &env, const float *offset, ThreadPool *pool,
+	std::vector<EpisodeResult> *results) {
+	World world;
+	spawn_flock(world, birds, env, offset);
+	Schedule schedule;
+	add_flappy_systems(schedule);
+	RunStats stats;
+	const auto start = std::chrono::steady_clock::now();
+	for (long t = 0; t < ticks && world.count() != 0; ++t) {
+		stats.steps += world.count();
+		schedule.run(world, pool);
+		std::vector<EpisodeResult> &finished = world.resource<Results>().episodes;
+		if (results) {
+			results->insert(results->end(), finished.begin(), finished.end());
+		}
+		finished.clear();
+	}
+	stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return stats;
+}
+
+static void usage(const char *argv0) {
+	std::fprintf(stderr, "usage: %s [--birds N] [--ticks N] [--threads N] [--seed N] [--bot-offset PIXELS]\n"
+		"       [--bot-spread PIXELS] [--check N]\n", argv0);
+	std::exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv) {
+	Options opt;
+	for (int i = 1; i < argc; ++i) {
+		auto value = [&] {
+			if (i + 1 == argc) {
+				usage(argv[0]);
+			}
+			return argv[++i];
+		};
+		if (std::strcmp(argv[i], "--birds") == 0) {
+			opt.birds = std::atoi(value());
+		} else if (std::strcmp(argv[i], "--ticks") == 0) {
+			opt.ticks = std::atol(value());
+		} else if (std::strcmp(argv[i], "--threads") == 0) {
+			opt.threads = std::atoi(value());
+		} else if (std::strcmp(argv[i], "--seed") == 0) {
+			opt.seed = std::strtoul(value(), nullptr, 10);
+		} else if (std::strcmp(argv[i], "--bot-offset") == 0) {
+			opt.bot_offset = std::atof(value());
+		} else if (std::strcmp(argv[i], "--bot-spread") == 0) {
+			opt.bot_spread = std::atof(value());
+		} else if (std::strcmp(argv[i], "--check") == 0) {
+			opt.check = std::atoi(value());
+		} else {
+			usage(argv[0]);
+		}
+	}
+	if (opt.birds < 1 || opt.ticks < 1 || opt.threads < 1 || opt.check < 0) {
+		usage(argv[0]);
+	}
+
+	const std::vector<float> offset = bot_offsets(std::max(opt.birds, opt.check), opt);
+	EnvOptions env;
+	env.first_seed = opt.seed;
+	env.slot_arena_bytes = 0;
+
+	// One episode per bird until every bird is down: the finished episodes
+	// have to match seed by seed.
+	if (opt.check != 0) {
+		EnvOptions once = env;
+		once.episodes = opt.check;
+		std::vector<EpisodeResult> expected;
+		std::vector<EpisodeResult> got;
+		run_batch(opt.check, once.max_episode_ticks + 1, once, offset.data(), &expected);
+		run_ecs(opt.check, once.max_episode_ticks + 1, once, offset.data(), nullptr, &got);
+		const auto by_seed = [](const EpisodeResult &a, const EpisodeResult &b) { return a.seed < b.seed; };
+		std::sort(expected.begin(), expected.end(), by_seed);
+		std::sort(got.begin(), got.end(), by_seed);
+		int mismatches = expected.size() != got.size();
+		for (std::size_t i = 0; i < std::min(expected.size(), got.size()); ++i) {
+			const EpisodeResult &a = expected[i];
+			const EpisodeResult &b = got[i];
+			mismatches += a.seed != b.seed || a.ticks != b.ticks || a.score != b.score || a.truncated != b.truncated;
+		}
+		if (mismatches != 0) {
+			std::fprintf(stderr, "ECS and EnvBatch disagree on %d of %zu episodes\n", mismatches, expected.size());
+			return EXIT_FAILURE;
+		}
+		std::printf("%zu single-episode games agree\n", expected.size());
+	}
+
+	Schedule schedule;
+	add_flappy_systems(schedule);
+	char systems[256];
+	schedule.describe(systems, sizeof(systems));
+	std::printf("systems: %s\n", systems);
+
+	const RunStats batch = run_batch(opt.birds, opt.ticks, env, offset.data(), nullptr);
+	const RunStats serial = run_ecs(opt.birds, opt.ticks, env, offset.data(), nullptr, nullptr);
+	RunStats parallel;
+	{
+		ThreadPool pool(opt.threads);
+		parallel = run_ecs(opt.birds, opt.ticks, env, offset.data(), &pool, nullptr);
+	}
+	std::printf("%d birds, %ld ticks\n", opt.birds, opt.ticks);
+	std::printf("EnvBatch loop:     %7.1f M bird-steps/s\n", batch.rate());
+	std::printf("ECS, one thread:   %7.1f M bird-steps/s (%.2fx)\n", serial.rate(), serial.rate() / batch.rate());
+	std::printf("ECS, %2d threads:   %7.1f M bird-steps/s (%.2fx)\n", opt.threads, parallel.rate(),
+		parallel.rate() / batch.rate());
+	return 0;
+}
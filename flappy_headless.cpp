@@ -0,0 +1,395 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#include "alloc_tracker.hpp"
+#include "arena.hpp"
+#include "bots.hpp"
+#include "env.hpp"
+#include "replay.hpp"
+#include "script_bots.hpp"
+#include "topology.hpp"
+
+// Seeds of different shards never overlap for runs below 2^24 episodes per shard.
+static constexpr std::uint32_t SHARD_SEED_STRIDE = 1u << 24;
+static constexpr int WARMUP_TICKS = 60;
+
+struct Options {
+	int threads = static_cast<int>(std::thread::hardware_concurrency());
+	int envs = 1024;
+	long ticks = 10000;
+	std::uint32_t seed = 1;
+	// deep enough that some birds clip the lower pipe, so resets get exercised
+	float bot_offset = 75.0f;
+	// each environment's offset is drawn from bot_offset +- bot_spread
+	float bot_spread = 0.0f;
+	std::uint32_t seed_stride = 1;
+	// episodes per shard, after which finished lanes are retired
+	std::uint64_t episodes = UNLIMITED_EPISODES;
+	bool pin = true;
+	bool compact = true;
+	bool prepare_resets = true;
+	// the reference bot as a coroutine script, to measure what scripting costs
+	bool scripted = false;
+	const char *record_dir = nullptr;
+	int record_top = 16;
+};
+
+struct Placement {
+	int node;
+	int cpu;
+};
+
+struct ShardStats {
+	std::uint64_t steps = 0;
+	std::uint64_t episodes = 0;
+	std::uint64_t resumes = 0;
+	double bot_seconds = 0.0;
+	std::uint64_t score_sum = 0;
+	int best_score = 0;
+	double seconds = 0.0;
+	bool huge_pages = false;
+	bool pinned = false;
+	int memory_node = -1;
+	alloc_tracker::Counts allocs;
+	// step() latency histogram, bucket b counts steps of [2^b, 2^(b+1)) ns
+	std::uint64_t latency[64] = {};
+	std::uint64_t worst_ns = 0;
+	int recorded = 0;
+	bool record_failed = false;
+};
+
+// The best episodes of one shard together with their flaps, copied into arena
+// memory so recording does not allocate on the step path.
+class BestRuns final {
+private:
+	struct Run {
+		EpisodeResult result;
+		std::uint32_t flap_count;
+		std::uint32_t *flaps;
+	};
+
+	Run *runs_ = nullptr;
+	int capacity_ = 0;
+	int count_ = 0;
+	std::uint32_t max_flaps_ = 0;
+public:
+	static std::size_t memory_needed(int capacity, std::uint32_t max_flaps) {
+		return capacity * (sizeof(Run) + max_flaps * sizeof(std::uint32_t) + Arena::CACHE_LINE) + Arena::CACHE_LINE;
+	}
+
+	BestRuns() = default;
+	BestRuns(Arena &arena, int capacity, std::uint32_t max_flaps)
+		: runs_(arena.make_array<Run>(capacity)), capacity_(capacity), max_flaps_(max_flaps) {
+		for (int i = 0; i < capacity_; ++i) {
+			runs_[i].flaps = arena.make_array<std::uint32_t>(max_flaps);
+		}
+	}
+
+	void offer(const EpisodeResult &r) {
+		if (capacity_ == 0 || r.flaps_truncated) {
+			return;
+		}
+		Run *run = nullptr;
+		if (count_ < capacity_) {
+			run = &runs_[count_++];
+		} else {
+			run = std::min_element(runs_, runs_ + count_, [](const Run &a, const Run &b) {
+				return a.result.score < b.result.score;
+			});
+			if (r.score <= run->result.score) {
+				return;
+			}
+		}
+		run->result = r;
+		run->flap_count = 0;
+		for_each_flap(r.flaps, [&](std::uint32_t tick) {
+			if (run->flap_count < max_flaps_) {
+				run->flaps[run->flap_count++] = tick;
+			}
+		});
+	}
+
+	// Writes the runs into `dir`, stopping at the first failure. Returns
+	// false if one could not be written.
+	bool write(const char *dir, int shard, int &written) const {
+		for (int i = 0; i < count_; ++i) {
+			const Run &run = runs_[i];
+			char path[4096];
+			std::snprintf(path, sizeof(path), "%s/seed-%u-score-%d-shard-%d-%d.replay",
+				dir, run.result.seed, run.result.score, shard, i);
+			if (!write_replay(path, run.result.seed, run.flaps, run.flap_count)) {
+				return false;
+			}
+			written += 1;
+		}
+		return true;
+	}
+};
+
+static BotScript reference_script(float offset) {
+	for (;;) {
+		co_await falling_below_gap(offset);
+		co_await flap();
+	}
+}
+
+static int log2_bucket(std::uint64_t ns) {
+	return ns ? 63 - __builtin_clzll(ns) : 0;
+}
+
+// Upper bound of the bucket holding quantile q.
+static std::uint64_t percentile(const std::uint64_t (&latency)[64], double q) {
+	std::uint64_t count = 0;
+	for (auto n : latency) {
+		count += n;
+	}
+	std::uint64_t seen = 0;
+	for (int b = 0; b < 64; ++b) {
+		seen += latency[b];
+		if (seen != 0 && seen >= q * count) {
+			return std::uint64_t{2} << b;
+		}
+	}
+	return 0;
+}
+
+static void run_shard(int shard, Placement place, const Options &opt, ShardStats &stats) {
+	// Pin before touching any memory: the worker maps and first-touches its
+	// own block, so the SoA arrays land on the node the thread runs on.
+	stats.pinned = opt.pin && pin_current_thread(place.cpu);
+	EnvOptions env_options;
+	env_options.first_seed = opt.seed + shard * SHARD_SEED_STRIDE * opt.seed_stride;
+	env_options.seed_stride = opt.seed_stride;
+	env_options.episodes = opt.episodes;
+	const int record_top = opt.record_dir ? opt.record_top : 0;
+	const std::uint32_t max_flaps = env_options.slot_arena_bytes / 2 / sizeof(FlapChunk) * (sizeof(FlapChunk::ticks) / sizeof(std::uint32_t));
+	PageBlock block(EnvBatch::memory_needed(opt.envs, env_options) + opt.envs * (1 + sizeof(float))
+		+ BestRuns::memory_needed(record_top, max_flaps) + (opt.scripted ? ScriptedBots::memory_needed(opt.envs) : 0)
+		+ 2 * Arena::CACHE_LINE);
+	Arena arena(block);
+	EnvBatch batch(opt.envs, arena, env_options);
+	batch.set_compaction(opt.compact);
+	std::uint8_t *flap = arena.make_array<std::uint8_t>(opt.envs);
+	float *offset = arena.make_array<float>(opt.envs);
+	Rng rng(env_options.first_seed);
+	std::uniform_real_distribution<float> spread(-opt.bot_spread, opt.bot_spread);
+	for (int i = 0; i < opt.envs; ++i) {
+		offset[i] = opt.bot_offset + (opt.bot_spread > 0.0f ? spread(rng) : 0.0f);
+	}
+	BestRuns best = record_top ? BestRuns(arena, record_top, max_flaps) : BestRuns();
+	std::optional<ScriptedBots> scripts;
+	if (opt.scripted) {
+		scripts.emplace(batch, arena, [offset](std::uint32_t env) { return reference_script(offset[env]); });
+	}
+	const auto decide = [&] {
+		if (scripts) {
+			scripts->decide(flap);
+		} else {
+			heuristic_bot(batch, flap, offset);
+		}
+	};
+	const auto restart = [&] {
+		if (scripts) {
+			scripts->restart_finished();
+		}
+	};
+	stats.huge_pages = block.huge_pages();
+	stats.memory_node = node_of_address(batch.y());
+
+	for (int t = 0; t < WARMUP_TICKS; ++t) {
+		decide();
+		batch.step(flap);
+		restart();
+	}
+	if (opt.prepare_resets) {
+		batch.prepare_resets();
+	}
+
+	const auto allocs_before = alloc_tracker::thread_counts();
+	const std::uint64_t resumes_before = scripts ? scripts->resumes() : 0;
+	std::chrono::steady_clock::duration bot_time{};
+	const auto start = std::chrono::steady_clock::now();
+	for (long t = 0; t < opt.ticks && batch.live() != 0; ++t) {
+		stats.steps += batch.active();
+		const auto bot_start = std::chrono::steady_clock::now();
+		decide();
+		const auto step_start = std::chrono::steady_clock::now();
+		bot_time += step_start - bot_start;
+		batch.step(flap);
+		const std::uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now() - step_start).count();
+		stats.latency[log2_bucket(ns)] += 1;
+		stats.worst_ns = ns > stats.worst_ns ? ns : stats.worst_ns;
+		for (int i = 0; i < batch.finished_count(); ++i) {
+			const EpisodeResult &r = batch.finished()[i];
+			stats.episodes += 1;
+			stats.score_sum += r.score;
+			if (r.score > stats.best_score) {
+				stats.best_score = r.score;
+			}
+			best.offer(r);
+		}
+		restart();
+		// restock the resets the step consumed while the lanes are idle
+		if (opt.prepare_resets) {
+			batch.prepare_resets();
+		}
+	}
+	const auto end = std::chrono::steady_clock::now();
+	stats.allocs = alloc_tracker::thread_counts() - allocs_before;
+	stats.seconds = std::chrono::duration<double>(end - start).count();
+	stats.bot_seconds = std::chrono::duration<double>(bot_time).count();
+	stats.resumes = scripts ? scripts->resumes() - resumes_before : 0;
+
+	if (opt.record_dir) {
+		stats.record_failed = !best.write(opt.record_dir, shard, stats.recorded);
+	}
+}
+
+static void usage(const char *argv0) {
+	std::fprintf(stderr, "usage: %s [--threads N] [--envs N] [--ticks N] [--seed N] [--seed-stride N]\n"
+		"       [--bot-offset PIXELS] [--bot-spread PIXELS] [--episodes N] [--record DIR] [--record-top N]\n"
+		"       [--no-compact] [--no-prepare-resets] [--no-pin] [--scripted]\n", argv0);
+	std::exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv) {
+	Options opt;
+	for (int i = 1; i < argc; ++i) {
+		auto value = [&] {
+			if (i + 1 == argc) {
+				usage(argv[0]);
+			}
+			return argv[++i];
+		};
+		if (std::strcmp(argv[i], "--threads") == 0) {
+			opt.threads = std::atoi(value());
+		} else if (std::strcmp(argv[i], "--envs") == 0) {
+			opt.envs = std::atoi(value());
+		} else if (std::strcmp(argv[i], "--ticks") == 0) {
+			opt.ticks = std::atol(value());
+		} else if (std::strcmp(argv[i], "--seed") == 0) {
+			opt.seed = std::strtoul(value(), nullptr, 10);
+		} else if (std::strcmp(argv[i], "--seed-stride") == 0) {
+			opt.seed_stride = std::strtoul(value(), nullptr, 10);
+		} else if (std::strcmp(argv[i], "--bot-offset") == 0) {
+			opt.bot_offset = std::atof(value());
+		} else if (std::strcmp(argv[i], "--bot-spread") == 0) {
+			opt.bot_spread = std::atof(value());
+		} else if (std::strcmp(argv[i], "--record") == 0) {
+			opt.record_dir = value();
+		} else if (std::strcmp(argv[i], "--record-top") == 0) {
+			opt.record_top = std::atoi(value());
+		} else if (std::strcmp(argv[i], "--episodes") == 0) {
+			opt.episodes = std::strtoull(value(), nullptr, 10);
+		} else if (std::strcmp(argv[i], "--no-compact") == 0) {
+			opt.compact = false;
+		} else if (std::strcmp(argv[i], "--no-prepare-resets") == 0) {
+			opt.prepare_resets = false;
+		} else if (std::strcmp(argv[i], "--no-pin") == 0) {
+			opt.pin = false;
+		} else if (std::strcmp(argv[i], "--scripted") == 0) {
+			opt.scripted = true;
+		} else {
+			usage(argv[0]);
+		}
+	}
+	if (opt.threads < 1 || opt.envs < 1 || opt.ticks < 1 || opt.episodes < 1) {
+		usage(argv[0]);
+	}
+
+	// Shards are dealt round-robin over the nodes so every socket gets work
+	// even when fewer threads than cores are requested.
+	const auto nodes = read_numa_topology();
+	std::vector<Placement> placement(opt.threads);
+	for (int shard = 0; shard < opt.threads; ++shard) {
+		const NumaNode &node = nodes[shard % nodes.size()];
+		const int slot = shard / nodes.size();
+		placement[shard] = Placement{node.id, node.cpus[slot % node.cpus.size()]};
+	}
+
+	std::vector<ShardStats> stats(opt.threads);
+	std::vector<std::thread> workers;
+	workers.reserve(opt.threads);
+	for (int shard = 0; shard < opt.threads; ++shard) {
+		workers.emplace_back(run_shard, shard, placement[shard], std::cref(opt), std::ref(stats[shard]));
+	}
+	for (auto &w : workers) {
+		w.join();
+	}
+
+	std::printf("threads %d, envs/thread %d, ticks %ld, huge pages %s\n",
+		opt.threads, opt.envs, opt.ticks, std::all_of(stats.begin(), stats.end(),
+			[](const ShardStats &s) { return s.huge_pages; }) ? "yes" : "transparent");
+	for (const NumaNode &node : nodes) {
+		int threads = 0;
+		int pinned = 0;
+		int local = 0;
+		double rate = 0.0;
+		for (int shard = 0; shard < opt.threads; ++shard) {
+			if (placement[shard].node != node.id) {
+				continue;
+			}
+			threads += 1;
+			pinned += stats[shard].pinned;
+			local += stats[shard].memory_node == node.id;
+			rate += stats[shard].steps / stats[shard].seconds;
+		}
+		if (threads != 0) {
+			std::printf("node %d: %d threads (%d pinned, %d with local memory), %.1f M env-steps/s\n",
+				node.id, threads, pinned, local, rate / 1e6);
+		}
+	}
+
+	ShardStats total;
+	for (const auto &s : stats) {
+		total.steps += s.steps;
+		total.episodes += s.episodes;
+		total.resumes += s.resumes;
+		total.bot_seconds += s.bot_seconds;
+		total.score_sum += s.score_sum;
+		total.best_score = s.best_score > total.best_score ? s.best_score : total.best_score;
+		total.seconds = s.seconds > total.seconds ? s.seconds : total.seconds;
+		total.allocs.calls += s.allocs.calls;
+		total.allocs.bytes += s.allocs.bytes;
+		for (int b = 0; b < 64; ++b) {
+			total.latency[b] += s.latency[b];
+		}
+		total.worst_ns = s.worst_ns > total.worst_ns ? s.worst_ns : total.worst_ns;
+		total.recorded += s.recorded;
+		total.record_failed = total.record_failed || s.record_failed;
+	}
+
+	std::printf("%.1f M env-steps/s, %llu episodes, mean score %.2f, best %d\n",
+		total.steps / total.seconds / 1e6, static_cast<unsigned long long>(total.episodes),
+		total.episodes ? static_cast<double>(total.score_sum) / total.episodes : 0.0, total.best_score);
+	std::printf("step latency: p50 < %.1f us, p99 < %.1f us, p99.9 < %.1f us, max %.1f us\n",
+		percentile(total.latency, 0.5) / 1e3, percentile(total.latency, 0.99) / 1e3,
+		percentile(total.latency, 0.999) / 1e3, total.worst_ns / 1e3);
+	// thread time over the env-steps of all threads
+	std::printf("bots: %.1f ns per env-step", total.bot_seconds / total.steps * 1e9);
+	if (opt.scripted) {
+		std::printf(", %.3f resumes per env-step", static_cast<double>(total.resumes) / total.steps);
+	}
+	std::printf("\n");
+	if (opt.record_dir) {
+		std::printf("recorded %d replays into %s\n", total.recorded, opt.record_dir);
+		if (total.record_failed) {
+			std::fprintf(stderr, "some replays could not be written into %s\n", opt.record_dir);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (total.allocs.calls != 0) {
+		std::fprintf(stderr, "ALLOC: steady-state env steps made %zu allocations (%zu bytes)\n",
+			total.allocs.calls, total.allocs.bytes);
+		return EXIT_FAILURE;
+	}
+	return 0;
+}
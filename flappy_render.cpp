@@ -0,0 +1,234 @@
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "raster.hpp"
+#include "replay.hpp"
+#include "thread_pool.hpp"
+
+// Renders replays to video without a window: one Y4M file or one PPM image
+// per frame, one frame per simulation tick at 60 FPS.
+
+enum class Format {
+	Y4m,
+	Ppm,
+};
+
+struct Options {
+	int threads = static_cast<int>(std::thread::hardware_concurrency());
+	Format format = Format::Y4m;
+	float scale = 1.0f;
+	const char *out_dir = ".";
+	std::vector<const char *> replays;
+};
+
+// Frames are rendered and encoded out of order by the pool and written in
+// order. Slot i % window holds frame i, so rendering never runs more than a
+// window ahead of the writer.
+struct FrameSlot {
+	Canvas canvas;
+	std::vector<std::uint8_t> bytes;
+	bool ready = false;
+};
+
+static_assert(sizeof(Rgb) == 3);
+
+// Limited-range BT.601 4:2:0, which is what players assume for Y4M.
+static void encode_y4m(const Canvas &canvas, std::vector<std::uint8_t> &out) {
+	static constexpr char FRAME_TAG[] = "FRAME\n";
+	const int w = canvas.width();
+	const int h = canvas.height();
+	out.resize(sizeof(FRAME_TAG) - 1 + w * h * 3 / 2);
+	std::memcpy(out.data(), FRAME_TAG, sizeof(FRAME_TAG) - 1);
+	std::uint8_t *luma = out.data() + sizeof(FRAME_TAG) - 1;
+	std::uint8_t *cb = luma + w * h;
+	std::uint8_t *cr = cb + w * h / 4;
+
+	for (int y = 0; y < h; y += 2) {
+		const Rgb *rows[2] = { canvas.row(y), canvas.row(y + 1) };
+		for (int x = 0; x < w; x += 2) {
+			int r = 0, g = 0, b = 0;
+			for (int dy = 0; dy < 2; ++dy) {
+				for (int dx = 0; dx < 2; ++dx) {
+					const Rgb p = rows[dy][x + dx];
+					luma[(y + dy) * w + x + dx] = ((66 * p.r + 129 * p.g + 25 * p.b + 128) >> 8) + 16;
+					r += p.r;
+					g += p.g;
+					b += p.b;
+				}
+			}
+			r /= 4;
+			g /= 4;
+			b /= 4;
+			cb[(y / 2) * (w / 2) + x / 2] = ((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128;
+			cr[(y / 2) * (w / 2) + x / 2] = ((112 * r - 94 * g - 18 * b + 128) >> 8) + 128;
+		}
+	}
+}
+
+static void encode_ppm(const Canvas &canvas, std::vector<std::uint8_t> &out) {
+	char header[32];
+	const int len = std::snprintf(header, sizeof(header), "P6\n%d %d\n255\n", canvas.width(), canvas.height());
+	const std::size_t pixels = std::size_t{3} * canvas.width() * canvas.height();
+	out.resize(len + pixels);
+	std::memcpy(out.data(), header, len);
+	std::memcpy(out.data() + len, canvas.pixels(), pixels);
+}
+
+static std::string output_stem(const Options &opt, const char *replay_path) {
+	std::string name = replay_path;
+	name = name.substr(name.find_last_of('/') + 1);
+	if (name.size() > 7 && name.compare(name.size() - 7, 7, ".replay") == 0) {
+		name.resize(name.size() - 7);
+	}
+	return std::string(opt.out_dir) + "/" + name;
+}
+
+// Returns false if an output file could not be written.
+static bool render_replay(const Options &opt, ThreadPool &pool, const char *path) {
+	ReplayFile replay(path);
+	if (!replay.valid()) {
+		std::fprintf(stderr, "%s: not a replay\n", path);
+		return false;
+	}
+	const ReplayHeader &h = replay.header();
+	const auto start = std::chrono::steady_clock::now();
+
+	std::vector<SceneState> scenes;
+	scenes.reserve(h.ticks + 1);
+	const EpisodeResult result = simulate_replay(h.seed, replay.flaps(), h.flap_count,
+		[&](std::uint32_t, const EnvBatch &batch) {
+			scenes.push_back(SceneState{batch.y()[0], batch.obstacle_x()[0] - batch.x()[0], batch.gap()[0],
+				batch.score()[0]});
+		});
+	if (result.score != h.score || result.ticks != h.ticks) {
+		std::fprintf(stderr, "%s: replay does not reproduce (score %d, recorded %d)\n", path, result.score, h.score);
+	}
+
+	// Y4M wants even dimensions for 4:2:0
+	const int width = static_cast<int>(SCREEN_WIDTH * opt.scale) & ~1;
+	const int height = static_cast<int>(SCREEN_HEIGHT * opt.scale) & ~1;
+	const std::string stem = output_stem(opt, path);
+	std::FILE *video = nullptr;
+	if (opt.format == Format::Y4m) {
+		video = std::fopen((stem + ".y4m").c_str(), "wb");
+		if (!video) {
+			std::fprintf(stderr, "%s.y4m: cannot open\n", stem.c_str());
+			return false;
+		}
+		std::fprintf(video, "YUV4MPEG2 W%d H%d F60:1 Ip A1:1 C420jpeg\n", width, height);
+	}
+
+	const std::size_t frames = scenes.size();
+	const std::size_t window = 2 * pool.size();
+	std::vector<FrameSlot> slots(window, FrameSlot{Canvas(width, height), {}, false});
+	std::mutex mutex;
+	std::condition_variable done;
+	auto submit = [&](std::size_t frame) {
+		pool.submit([&, frame] {
+			FrameSlot &slot = slots[frame % window];
+			draw_scene(slot.canvas, scenes[frame]);
+			if (opt.format == Format::Y4m) {
+				encode_y4m(slot.canvas, slot.bytes);
+			} else {
+				encode_ppm(slot.canvas, slot.bytes);
+			}
+			// notified under the lock: once the last frame is seen ready,
+			// render_replay() may return and destroy mutex and done
+			std::lock_guard lock(mutex);
+			slot.ready = true;
+			done.notify_all();
+		});
+	};
+	for (std::size_t frame = 0; frame < std::min(window, frames); ++frame) {
+		submit(frame);
+	}
+
+	bool ok = true;
+	for (std::size_t frame = 0; frame < frames; ++frame) {
+		FrameSlot &slot = slots[frame % window];
+		{
+			std::unique_lock lock(mutex);
+			done.wait(lock, [&] { return slot.ready; });
+			slot.ready = false;
+		}
+		if (video) {
+			ok = ok && std::fwrite(slot.bytes.data(), 1, slot.bytes.size(), video) == slot.bytes.size();
+		} else {
+			char name[32];
+			std::snprintf(name, sizeof(name), "-%05zu.ppm", frame);
+			std::FILE *image = std::fopen((stem + name).c_str(), "wb");
+			ok = ok && image && std::fwrite(slot.bytes.data(), 1, slot.bytes.size(), image) == slot.bytes.size();
+			ok = image && std::fclose(image) == 0 && ok;
+		}
+		if (frame + window < frames) {
+			submit(frame + window);
+		}
+	}
+	if (video) {
+		ok = std::fclose(video) == 0 && ok;
+	}
+	if (!ok) {
+		std::fprintf(stderr, "%s: writing frames failed\n", stem.c_str());
+		return false;
+	}
+
+	const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	const double played = frames / 60.0;
+	std::printf("%s: score %d, %zu frames (%.1f s) in %.2f s, %.0fx real time\n", path, h.score, frames, played,
+		seconds, played / seconds);
+	return true;
+}
+
+static void usage(const char *argv0) {
+	std::fprintf(stderr, "usage: %s [--threads N] [--format y4m|ppm] [--scale S] [--out DIR] REPLAY...\n", argv0);
+	std::exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv) {
+	Options opt;
+	for (int i = 1; i < argc; ++i) {
+		auto value = [&] {
+			if (i + 1 == argc) {
+				usage(argv[0]);
+			}
+			return argv[++i];
+		};
+		if (std::strcmp(argv[i], "--threads") == 0) {
+			opt.threads = std::atoi(value());
+		} else if (std::strcmp(argv[i], "--format") == 0) {
+			const char *format = value();
+			if (std::strcmp(format, "y4m") == 0) {
+				opt.format = Format::Y4m;
+			} else if (std::strcmp(format, "ppm") == 0) {
+				opt.format = Format::Ppm;
+			} else {
+				usage(argv[0]);
+			}
+		} else if (std::strcmp(argv[i], "--scale") == 0) {
+			opt.scale = std::atof(value());
+		} else if (std::strcmp(argv[i], "--out") == 0) {
+			opt.out_dir = value();
+		} else if (argv[i][0] == '-') {
+			usage(argv[0]);
+		} else {
+			opt.replays.push_back(argv[i]);
+		}
+	}
+	if (opt.threads < 1 || opt.scale < 0.01f || opt.scale > 8.0f || opt.replays.empty()) {
+		usage(argv[0]);
+	}
+
+	ThreadPool pool(opt.threads);
+	bool ok = true;
+	for (const char *path : opt.replays) {
+		ok = render_replay(opt, pool, path) && ok;
+	}
+	return ok ? 0 : EXIT_FAILURE;
+}
@@ -0,0 +1,124 @@
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "arena.hpp"
+#include "bots.hpp"
+#include "env.hpp"
+#include "state_stream.hpp"
+
+// Spectator server: plays a number of bot games in real time and streams
+// their state to anyone who subscribes, see state_stream.hpp. Watch with
+// `flappy_term --watch-state HOST:PORT`.
+
+struct Options {
+	int games = 64;
+	int port = 7100;
+	std::uint32_t seed = 1;
+	double seconds = 0.0;
+};
+
+static volatile std::sig_atomic_t STOP = 0;
+
+static void usage(const char *argv0) {
+	std::fprintf(stderr, "usage: %s [--games N] [--port N] [--seed N] [--seconds S]\n", argv0);
+	std::exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv) {
+	Options opt;
+	for (int i = 1; i < argc; ++i) {
+		auto value = [&] {
+			if (i + 1 == argc) {
+				usage(argv[0]);
+			}
+			return argv[++i];
+		};
+		if (std::strcmp(argv[i], "--games") == 0) {
+			opt.games = std::atoi(value());
+		} else if (std::strcmp(argv[i], "--port") == 0) {
+			opt.port = std::atoi(value());
+		} else if (std::strcmp(argv[i], "--seed") == 0) {
+			opt.seed = std::strtoul(value(), nullptr, 10);
+		} else if (std::strcmp(argv[i], "--seconds") == 0) {
+			opt.seconds = std::atof(value());
+		} else {
+			usage(argv[0]);
+		}
+	}
+	if (opt.games < 1 || opt.games > 65535) {
+		usage(argv[0]);
+	}
+
+	StateStream stream(opt.games);
+	if (!stream.listen(opt.port)) {
+		return EXIT_FAILURE;
+	}
+	std::signal(SIGINT, [](int) { STOP = 1; });
+	std::signal(SIGTERM, [](int) { STOP = 1; });
+
+	EnvOptions env;
+	env.first_seed = opt.seed;
+	env.slot_arena_bytes = 0;
+	PageBlock block(EnvBatch::memory_needed(opt.games, env) + opt.games * (2 + sizeof(float)) + 3 * Arena::CACHE_LINE);
+	Arena arena(block);
+	EnvBatch batch(opt.games, arena, env);
+	std::uint8_t *flap = arena.make_array<std::uint8_t>(opt.games);
+	std::uint8_t *restarted = arena.make_array<std::uint8_t>(opt.games);
+	float *offset = arena.make_array<float>(opt.games);
+	Rng rng(opt.seed);
+	std::uniform_real_distribution<float> u(20.0f, 85.0f);
+	for (int i = 0; i < opt.games; ++i) {
+		offset[i] = u(rng);
+	}
+
+	std::printf("serving %d games on port %d\n", opt.games, opt.port);
+	using Clock = std::chrono::steady_clock;
+	const auto start = Clock::now();
+	auto next_tick = start;
+	auto next_report = start + std::chrono::seconds(10);
+	std::uint64_t last_bytes = 0;
+	std::uint64_t ticks = 0;
+	while (!STOP && (opt.seconds <= 0.0 || ticks < opt.seconds / SIM_DT)) {
+		heuristic_bot(batch, flap, offset);
+		batch.step(flap);
+		batch.prepare_resets();
+		for (int i = 0; i < batch.finished_count(); ++i) {
+			restarted[batch.finished()[i].env] = 1;
+		}
+		for (int i = 0; i < batch.live(); ++i) {
+			const std::uint32_t game = batch.lane_env()[i];
+			stream.update(game, SpectatorState{batch.y()[i], batch.vy()[i], batch.obstacle_x()[i] - batch.x()[i],
+				batch.gap()[i], batch.score()[i]}, restarted[game]);
+			restarted[game] = 0;
+		}
+		stream.flush();
+		ticks += 1;
+
+		next_tick += std::chrono::nanoseconds(static_cast<long>(SIM_DT * 1e9));
+		const auto now = Clock::now();
+		if (now >= next_report) {
+			const double seconds = std::chrono::duration<double>(now - next_report).count() + 10.0;
+			std::printf("%d spectators, %.1f KB/s, %llu keyframe skips\n", stream.clients(),
+				(stream.bytes_sent() - last_bytes) / seconds / 1024.0,
+				static_cast<unsigned long long>(stream.skips()));
+			std::fflush(stdout);
+			last_bytes = stream.bytes_sent();
+			next_report = now + std::chrono::seconds(10);
+		}
+		if (next_tick < now) {
+			next_tick = now;
+		}
+		std::this_thread::sleep_until(next_tick);
+	}
+
+	const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+	std::printf("%llu ticks, %d spectators, %.1f KB/s sent\n", static_cast<unsigned long long>(ticks),
+		stream.clients(), stream.bytes_sent() / seconds / 1024.0);
+	return 0;
+}
@@ -0,0 +1,353 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "arena.hpp"
+#include "bots.hpp"
+#include "env.hpp"
+#include "eval_cache.hpp"
+#include "hash.hpp"
+#include "thread_pool.hpp"
+
+// Balance sweeps: plays the same seeds with the reference bots on every point
+// of a grid of rules and reports how long the birds last. Every game goes
+// into the evaluation cache, see eval_cache.hpp, so a sweep can be widened or
+// refined and re-run for the cost of the new games only.
+
+static constexpr int SHARD_GAMES = 1024;
+// survival is reported as the share of games that scored at least this much
+static constexpr int SURVIVAL_SCORES[] = { 1, 2, 5, 10, 20 };
+static constexpr int SURVIVAL_COUNT = sizeof(SURVIVAL_SCORES) / sizeof(SURVIVAL_SCORES[0]);
+
+// A value given as "V" or swept as "FIRST:LAST:STEPS".
+struct Range {
+	double first;
+	double last;
+	int steps = 1;
+
+	double at(int i) const { return steps == 1 ? first : first + (last - first) * i / (steps - 1); }
+};
+
+struct Options {
+	Range speed{HORIZONTAL_VELOCITY, HORIZONTAL_VELOCITY};
+	Range gravity{GRAV_ACCELERATION, GRAV_ACCELERATION};
+	Range flap_force{FLAP_FORCE, FLAP_FORCE};
+	Range gap_size{GAP_SIZE, GAP_SIZE};
+	Range gap_min{GAP_MIN, GAP_MIN};
+	Range gap_max{GAP_MAX, GAP_MAX};
+	int games = 2000;
+	std::uint32_t seed = 1;
+	// each game's bot flaps at an offset drawn from bot_offset +- bot_spread,
+	// a population of players from careful to sloppy
+	float bot_offset = 75.0f;
+	float bot_spread = 35.0f;
+	std::uint32_t max_ticks = 3 * 60 * 60;
+	int threads = static_cast<int>(std::thread::hardware_concurrency());
+	const char *cache = "evals";
+	const char *csv = nullptr;
+};
+
+// What a point's games came to.
+struct PointResult {
+	std::uint32_t games;
+	std::uint32_t truncated;
+	double mean;
+	std::int32_t p10;
+	std::int32_t p50;
+	std::int32_t p90;
+	std::int32_t max;
+	std::uint32_t survived[SURVIVAL_COUNT];
+};
+
+struct Point {
+	Rules rules;
+	std::uint64_t rules_key;
+	PointResult result;
+	// one per game, in seed order
+	std::vector<EvalResult> games;
+};
+
+// The bot of the game on `seed`; the same for every point, so points differ
+// by their rules only. Drawn from a hash of the seed: consecutive seeds must
+// give unrelated bots.
+static float bot_offset(std::uint32_t seed, const Options &opt) {
+	const double u = (mix_seed(Hasher().add(seed).value()) >> 11) * 0x1p-53;
+	return opt.bot_offset + static_cast<float>((2.0 * u - 1.0) * opt.bot_spread);
+}
+
+static std::uint64_t bot_key(float offset) {
+	return BotSpec{BotSpec::HEURISTIC, offset}.key();
+}
+
+static EvalKey game_key(const Point &point, int game, const Options &opt) {
+	const std::uint32_t seed = opt.seed + game;
+	return EvalKey{bot_key(bot_offset(seed, opt)), point.rules_key, seed};
+}
+
+// Plays games [first, first + count) of a point, each in its own environment.
+static void play_shard(Point &point, int first, int count, const Options &opt) {
+	EnvOptions env;
+	env.first_seed = opt.seed + first;
+	env.episodes = count;
+	env.slot_arena_bytes = 0;
+	env.rules = point.rules;
+	env.max_episode_ticks = opt.max_ticks;
+	thread_local std::vector<char> memory;
+	memory.resize(EnvBatch::memory_needed(count, env) + count * (1 + sizeof(float)) + 2 * Arena::CACHE_LINE);
+	Arena arena(memory.data(), memory.size());
+	EnvBatch batch(count, arena, env);
+	std::uint8_t *flap = arena.make_array<std::uint8_t>(count);
+	float *offset = arena.make_array<float>(count);
+	for (int i = 0; i < count; ++i) {
+		offset[i] = bot_offset(env.first_seed + i, opt);
+	}
+	while (batch.live() != 0) {
+		heuristic_bot(batch, flap, offset);
+		batch.step(flap);
+		for (int i = 0; i < batch.finished_count(); ++i) {
+			const EpisodeResult &r = batch.finished()[i];
+			point.games[first + r.env] = EvalResult{r.score, r.ticks, r.truncated};
+		}
+	}
+}
+
+static PointResult summarize(const std::vector<EvalResult> &games) {
+	PointResult result = {};
+	result.games = games.size();
+	std::vector<std::int32_t> scores;
+	scores.reserve(games.size());
+	double sum = 0.0;
+	for (const EvalResult &game : games) {
+		const std::int32_t s = game.score;
+		scores.push_back(s);
+		result.truncated += game.truncated;
+		sum += s;
+		for (int k = 0; k < SURVIVAL_COUNT; ++k) {
+			result.survived[k] += s >= SURVIVAL_SCORES[k];
+		}
+	}
+	std::sort(scores.begin(), scores.end());
+	const auto quantile = [&](double q) { return scores[std::min<std::size_t>(q * scores.size(), scores.size() - 1)]; };
+	result.mean = sum / scores.size();
+	result.p10 = quantile(0.1);
+	result.p50 = quantile(0.5);
+	result.p90 = quantile(0.9);
+	result.max = scores.back();
+	return result;
+}
+
+static bool parse_range(const char *text, Range &range) {
+	char tail;
+	const int fields = std::sscanf(text, "%lf:%lf:%d%c", &range.first, &range.last, &range.steps, &tail);
+	if (fields == 1) {
+		range.last = range.first;
+		range.steps = 1;
+		return true;
+	}
+	return fields == 3 && range.steps >= 1;
+}
+
+static void usage(const char *argv0) {
+	std::fprintf(stderr, "usage: %s [--speed R] [--gravity R] [--flap-force R] [--gap-size R] [--gap-min R] [--gap-max R]\n"
+		"       [--games N] [--seed N] [--bot-offset PIXELS] [--bot-spread PIXELS] [--max-ticks N]\n"
+		"       [--threads N] [--cache PATH | --no-cache] [--csv FILE]\n"
+		"R is a value V or a range FIRST:LAST:STEPS; the sweep covers every combination\n", argv0);
+	std::exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv) {
+	Options opt;
+	for (int i = 1; i < argc; ++i) {
+		auto value = [&] {
+			if (i + 1 == argc) {
+				usage(argv[0]);
+			}
+			return argv[++i];
+		};
+		auto range = [&](Range &r) {
+			if (!parse_range(value(), r)) {
+				usage(argv[0]);
+			}
+		};
+		if (std::strcmp(argv[i], "--speed") == 0) {
+			range(opt.speed);
+		} else if (std::strcmp(argv[i], "--gravity") == 0) {
+			range(opt.gravity);
+		} else if (std::strcmp(argv[i], "--flap-force") == 0) {
+			range(opt.flap_force);
+		} else if (std::strcmp(argv[i], "--gap-size") == 0) {
+			range(opt.gap_size);
+		} else if (std::strcmp(argv[i], "--gap-min") == 0) {
+			range(opt.gap_min);
+		} else if (std::strcmp(argv[i], "--gap-max") == 0) {
+			range(opt.gap_max);
+		} else if (std::strcmp(argv[i], "--games") == 0) {
+			opt.games = std::atoi(value());
+		} else if (std::strcmp(argv[i], "--seed") == 0) {
+			opt.seed = std::strtoul(value(), nullptr, 10);
+		} else if (std::strcmp(argv[i], "--bot-offset") == 0) {
+			opt.bot_offset = std::atof(value());
+		} else if (std::strcmp(argv[i], "--bot-spread") == 0) {
+			opt.bot_spread = std::atof(value());
+		} else if (std::strcmp(argv[i], "--max-ticks") == 0) {
+			opt.max_ticks = std::strtoul(value(), nullptr, 10);
+		} else if (std::strcmp(argv[i], "--threads") == 0) {
+			opt.threads = std::atoi(value());
+		} else if (std::strcmp(argv[i], "--cache") == 0) {
+			opt.cache = value();
+		} else if (std::strcmp(argv[i], "--no-cache") == 0) {
+			opt.cache = nullptr;
+		} else if (std::strcmp(argv[i], "--csv") == 0) {
+			opt.csv = value();
+		} else {
+			usage(argv[0]);
+		}
+	}
+	if (opt.games < 1 || opt.threads < 1 || opt.max_ticks < 1) {
+		usage(argv[0]);
+	}
+
+	std::vector<Point> points;
+	for (int a = 0; a < opt.speed.steps; ++a)
+	for (int b = 0; b < opt.gravity.steps; ++b)
+	for (int c = 0; c < opt.flap_force.steps; ++c)
+	for (int d = 0; d < opt.gap_size.steps; ++d)
+	for (int e = 0; e < opt.gap_min.steps; ++e)
+	for (int f = 0; f < opt.gap_max.steps; ++f) {
+		Rules rules;
+		rules.horizontal_velocity = opt.speed.at(a);
+		rules.gravity = opt.gravity.at(b);
+		rules.flap_force = opt.flap_force.at(c);
+		rules.gap_size = opt.gap_size.at(d);
+		rules.gap_min = opt.gap_min.at(e);
+		rules.gap_max = opt.gap_max.at(f);
+		if (rules.horizontal_velocity <= 0.0f || rules.gap_size <= 0 || rules.gap_min > rules.gap_max) {
+			std::fprintf(stderr, "skipping a point with speed %g, gap size %d, gap range %d-%d\n",
+				rules.horizontal_velocity, rules.gap_size, rules.gap_min, rules.gap_max);
+			continue;
+		}
+		points.push_back(Point{rules, rules_key(rules, opt.max_ticks), {}, std::vector<EvalResult>(opt.games)});
+	}
+
+	EvalCache cache;
+	if (opt.cache && !cache.open(opt.cache)) {
+		return EXIT_FAILURE;
+	}
+
+	// Points are cut into shards of up to SHARD_GAMES games, so a small sweep
+	// still keeps every thread busy. Only the games missing from the cache are
+	// played, a run of consecutive seeds at a time; batches of consecutive
+	// seeds are what EnvBatch plays best.
+	struct Shard {
+		Point *point;
+		int first;
+		int count;
+	};
+	std::vector<Shard> to_play;
+	long cached_games = 0;
+	for (Point &point : points) {
+		for (int first = 0; first < opt.games; first += SHARD_GAMES) {
+			const int end = std::min(first + SHARD_GAMES, opt.games);
+			int missing = end;
+			for (int game = first; game < end; ++game) {
+				if (cache.find(game_key(point, game, opt), point.games[game])) {
+					cached_games += 1;
+					if (missing != end) {
+						to_play.push_back(Shard{&point, missing, game - missing});
+						missing = end;
+					}
+				} else if (missing == end) {
+					missing = game;
+				}
+			}
+			if (missing != end) {
+				to_play.push_back(Shard{&point, missing, end - missing});
+			}
+		}
+	}
+	std::fprintf(stderr, "%zu points x %d games, %ld cached, playing %zu shards on %d threads\n",
+		points.size(), opt.games, cached_games, to_play.size(), opt.threads);
+
+	const auto start = std::chrono::steady_clock::now();
+	std::atomic<int> shards_done{0};
+	const int shards = to_play.size();
+	{
+		ThreadPool pool(opt.threads);
+		for (const Shard &shard : to_play) {
+			pool.submit([shard, &opt, &shards_done] {
+				play_shard(*shard.point, shard.first, shard.count, opt);
+				shards_done.fetch_add(1, std::memory_order_relaxed);
+			});
+		}
+		while (shards_done.load(std::memory_order_relaxed) < shards) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(250));
+			std::fprintf(stderr, "\r%d / %d shards", shards_done.load(std::memory_order_relaxed), shards);
+		}
+		if (shards != 0) {
+			std::fprintf(stderr, "\n");
+		}
+	}
+	const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	if (cache.writable()) {
+		for (const Shard &shard : to_play) {
+			for (int game = shard.first; game < shard.first + shard.count; ++game) {
+				cache.insert(game_key(*shard.point, game, opt), shard.point->games[game]);
+			}
+		}
+	}
+	for (Point &point : points) {
+		point.result = summarize(point.games);
+	}
+
+	std::FILE *csv = opt.csv ? std::fopen(opt.csv, "w") : nullptr;
+	if (opt.csv && !csv) {
+		std::perror(opt.csv);
+	}
+	std::printf("%7s %7s %8s %4s %4s %4s %7s %4s %4s %4s %4s", "speed", "gravity", "flap", "gap", "min", "max",
+		"mean", "p10", "p50", "p90", "max");
+	if (csv) {
+		std::fprintf(csv, "speed,gravity,flap_force,gap_size,gap_min,gap_max,games,truncated,mean,p10,p50,p90,max");
+	}
+	for (int k = 0; k < SURVIVAL_COUNT; ++k) {
+		std::printf("  >=%-3d", SURVIVAL_SCORES[k]);
+		if (csv) {
+			std::fprintf(csv, ",survive_%d", SURVIVAL_SCORES[k]);
+		}
+	}
+	std::printf("  capped\n");
+	if (csv) {
+		std::fprintf(csv, "\n");
+	}
+	for (const Point &point : points) {
+		const Rules &r = point.rules;
+		const PointResult &p = point.result;
+		std::printf("%7.1f %7.1f %8.0f %4d %4d %4d %7.2f %4d %4d %4d %4d", r.horizontal_velocity, r.gravity,
+			r.flap_force, r.gap_size, r.gap_min, r.gap_max, p.mean, p.p10, p.p50, p.p90, p.max);
+		if (csv) {
+			std::fprintf(csv, "%g,%g,%g,%d,%d,%d,%u,%u,%.4f,%d,%d,%d,%d", r.horizontal_velocity, r.gravity,
+				r.flap_force, r.gap_size, r.gap_min, r.gap_max, p.games, p.truncated, p.mean, p.p10, p.p50,
+				p.p90, p.max);
+		}
+		for (int k = 0; k < SURVIVAL_COUNT; ++k) {
+			std::printf(" %5.1f%%", 100.0 * p.survived[k] / p.games);
+			if (csv) {
+				std::fprintf(csv, ",%.4f", static_cast<double>(p.survived[k]) / p.games);
+			}
+		}
+		// games still going at --max-ticks
+		std::printf(" %6.1f%%\n", 100.0 * p.truncated / p.games);
+		if (csv) {
+			std::fprintf(csv, "\n");
+		}
+	}
+	if (csv) {
+		std::fclose(csv);
+	}
+	std::fprintf(stderr, "played %d shards in %.1f s\n", shards, seconds);
+	return 0;
+}
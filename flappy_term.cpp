@@ -0,0 +1,853 @@
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstdint>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <optional>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <netdb.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "bots.hpp"
+#include "env.hpp"
+#include "frame_stream.hpp"
+#include "raster.hpp"
+#include "state_stream.hpp"
+
+// Plays the game in a terminal, for boxes without a display. The scene is
+// rasterized at two pixels per character cell and drawn with upper half
+// blocks; each frame only the cells that changed are sent, so a game over SSH
+// costs a few kilobytes per second.
+
+static constexpr Rgb BLACK = { 0, 0, 0 };
+static constexpr auto TICK = std::chrono::nanoseconds(1'000'000'000 / 60);
+static constexpr int MAX_TICKS_PER_FRAME = 4;
+
+static volatile std::sig_atomic_t RESIZED = 1;
+static volatile std::sig_atomic_t HANGUP = 0;
+
+static bool write_all(const char *data, std::size_t size) {
+	while (size != 0) {
+		const ssize_t n = write(STDOUT_FILENO, data, size);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return false;
+		}
+		data += n;
+		size -= n;
+	}
+	return true;
+}
+
+// Raw mode and the alternate screen while the object lives.
+class Terminal final {
+private:
+	termios saved_{};
+public:
+	Terminal() {
+		tcgetattr(STDIN_FILENO, &saved_);
+		termios raw = saved_;
+		raw.c_iflag &= ~(BRKINT | ICRNL | INPCK | ISTRIP | IXON);
+		raw.c_oflag &= ~OPOST;
+		raw.c_lflag &= ~(ECHO | ICANON | IEXTEN | ISIG);
+		raw.c_cc[VMIN] = 0;
+		raw.c_cc[VTIME] = 0;
+		tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw);
+		static constexpr char ENTER[] = "\x1b[?1049h\x1b[?25l";
+		write_all(ENTER, sizeof(ENTER) - 1);
+	}
+
+	~Terminal() {
+		static constexpr char LEAVE[] = "\x1b[0m\x1b[?25h\x1b[?1049l";
+		write_all(LEAVE, sizeof(LEAVE) - 1);
+		tcsetattr(STDIN_FILENO, TCSAFLUSH, &saved_);
+	}
+
+	Terminal(const Terminal&) = delete;
+	Terminal& operator=(const Terminal&) = delete;
+
+	static bool size(int &cols, int &rows) {
+		winsize ws{};
+		if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) != 0 || ws.ws_col == 0 || ws.ws_row == 0) {
+			return false;
+		}
+		cols = ws.ws_col;
+		rows = ws.ws_row;
+		return true;
+	}
+};//~ Terminal
+
+struct Cell {
+	Rgb fg;
+	Rgb bg;
+	// 0 draws an upper half block, fg over bg; for ' ' fg does not matter
+	char ch;
+
+	bool operator==(const Cell &) const = default;
+};
+
+// Nearest color of the xterm 256-color palette: the 6x6x6 cube or the gray ramp.
+static int xterm_index(Rgb c) {
+	static constexpr int LEVELS[6] = { 0, 95, 135, 175, 215, 255 };
+	auto nearest_level = [](int v) { return v < 48 ? 0 : v < 115 ? 1 : (v - 35) / 40; };
+	auto distance = [&](int r, int g, int b) {
+		return (r - c.r) * (r - c.r) + (g - c.g) * (g - c.g) + (b - c.b) * (b - c.b);
+	};
+	const int r = nearest_level(c.r);
+	const int g = nearest_level(c.g);
+	const int b = nearest_level(c.b);
+	const int gray = std::min(23, std::max(0, ((c.r + c.g + c.b) / 3 - 3) / 10));
+	const int gray_level = 8 + 10 * gray;
+	if (distance(gray_level, gray_level, gray_level) < distance(LEVELS[r], LEVELS[g], LEVELS[b])) {
+		return 232 + gray;
+	}
+	return 16 + 36 * r + 6 * g + b;
+}
+
+// The cells the terminal shows and the cells of the frame being composed.
+// flush() turns the difference into escape sequences, skipping unchanged
+// cells with cursor moves and sending colors only when they change.
+class Screen final {
+private:
+	// never composed, so every cell differs after a resize
+	static constexpr Cell UNKNOWN = { BLACK, BLACK, '\x01' };
+
+	int cols_ = 0;
+	int rows_ = 0;
+	bool truecolor_;
+	std::vector<Cell> shown_;
+	std::vector<Cell> next_;
+	std::string out_;
+	// -1 while unknown, e.g. after writing the last column
+	int cursor_x_ = -1;
+	int cursor_y_ = -1;
+	bool fg_known_ = false;
+	bool bg_known_ = false;
+	Rgb fg_ = BLACK;
+	Rgb bg_ = BLACK;
+
+	void append_number(int value) {
+		char digits[12];
+		const auto result = std::to_chars(digits, digits + sizeof(digits), value);
+		out_.append(digits, result.ptr);
+	}
+
+	static std::size_t digits(int value) {
+		return value < 10 ? 1 : value < 100 ? 2 : value < 1000 ? 3 : 4;
+	}
+
+	void append_color(const char *layer, Rgb c) {
+		out_ += layer;
+		if (truecolor_) {
+			out_ += "2;";
+			append_number(c.r);
+			out_ += ';';
+			append_number(c.g);
+			out_ += ';';
+			append_number(c.b);
+		} else {
+			out_ += "5;";
+			append_number(xterm_index(c));
+		}
+	}
+
+	void append_move(int n, char direction) {
+		out_ += "\x1b[";
+		if (n > 1) {
+			append_number(n);
+		}
+		out_ += direction;
+	}
+
+	// Picks the shortest of a relative move, a line feed and an absolute move.
+	void move_to(int x, int y) {
+		if (y == cursor_y_ && x == cursor_x_) {
+			return;
+		}
+		const std::size_t start = out_.size();
+		std::size_t relative = SIZE_MAX;
+		if (x == 0 && y == cursor_y_ + 1 && cursor_y_ >= 0) {
+			out_ += "\r\n";
+			relative = out_.size() - start;
+		} else if (cursor_x_ >= 0 && y >= cursor_y_) {
+			if (y > cursor_y_) {
+				append_move(y - cursor_y_, 'B');
+			}
+			if (x != cursor_x_) {
+				append_move(std::abs(x - cursor_x_), x > cursor_x_ ? 'C' : 'D');
+			}
+			relative = out_.size() - start;
+		}
+
+		const std::size_t absolute = 3 + (y != 0 || x != 0 ? digits(y + 1) : 0) + (x != 0 ? 1 + digits(x + 1) : 0);
+		if (absolute < relative) {
+			out_.resize(start);
+			out_ += "\x1b[";
+			if (x != 0 || y != 0) {
+				append_number(y + 1);
+				if (x != 0) {
+					out_ += ';';
+					append_number(x + 1);
+				}
+			}
+			out_ += 'H';
+		}
+		cursor_x_ = x;
+		cursor_y_ = y;
+	}
+
+	void set_colors(const Cell &cell) {
+		const bool fg = cell.ch != ' ' && (!fg_known_ || cell.fg != fg_);
+		const bool bg = !bg_known_ || cell.bg != bg_;
+		if (!fg && !bg) {
+			return;
+		}
+		out_ += "\x1b[";
+		if (fg) {
+			append_color("38;", cell.fg);
+			fg_ = cell.fg;
+		}
+		if (bg) {
+			append_color(fg ? ";48;" : "48;", cell.bg);
+			bg_ = cell.bg;
+		}
+		out_ += 'm';
+		fg_known_ = fg_known_ || fg;
+		bg_known_ = true;
+	}
+public:
+	explicit Screen(bool truecolor) : truecolor_(truecolor) {}
+
+	int cols() const { return cols_; }
+	int rows() const { return rows_; }
+
+	void resize(int cols, int rows) {
+		cols_ = cols;
+		rows_ = rows;
+		shown_.assign(cols * rows, UNKNOWN);
+		next_.assign(cols * rows, Cell{BLACK, BLACK, ' '});
+		cursor_x_ = cursor_y_ = -1;
+		fg_known_ = bg_known_ = false;
+	}
+
+	void fill(Rgb color) {
+		std::fill(next_.begin(), next_.end(), Cell{color, color, ' '});
+	}
+
+	// Two canvas rows per cell row, starting at cell (x, y).
+	void blit(const Canvas &canvas, int x, int y) {
+		for (int j = 0; j + 1 < canvas.height(); j += 2) {
+			const int row = y + j / 2;
+			if (row < 0 || row >= rows_) {
+				continue;
+			}
+			const Rgb *top = canvas.row(j);
+			const Rgb *bottom = canvas.row(j + 1);
+			for (int i = 0; i < canvas.width(); ++i) {
+				if (x + i >= 0 && x + i < cols_) {
+					next_[row * cols_ + x + i] = top[i] == bottom[i] ? Cell{bottom[i], bottom[i], ' '}
+						: Cell{top[i], bottom[i], 0};
+				}
+			}
+		}
+	}
+
+	// Text over whatever background the cells already have.
+	void text(int x, int y, const char *s, Rgb color) {
+		if (y < 0 || y >= rows_) {
+			return;
+		}
+		for (; *s; ++s, ++x) {
+			if (x >= 0 && x < cols_) {
+				Cell &cell = next_[y * cols_ + x];
+				cell = Cell{color, cell.bg, *s};
+			}
+		}
+	}
+
+	// Escape sequences that bring the terminal to the composed frame; empty
+	// when nothing changed.
+	const std::string &flush() {
+		out_.clear();
+		for (int y = 0; y < rows_; ++y) {
+			for (int x = 0; x < cols_; ++x) {
+				const int i = y * cols_ + x;
+				const Cell &cell = next_[i];
+				if (cell == shown_[i]) {
+					continue;
+				}
+				move_to(x, y);
+				set_colors(cell);
+				if (cell.ch == 0) {
+					out_ += "\xe2\x96\x80";
+				} else {
+					out_ += cell.ch;
+				}
+				shown_[i] = cell;
+				cursor_x_ = x + 1 < cols_ ? x + 1 : -1;
+			}
+		}
+		return out_;
+	}
+};//~ Screen
+
+// Where the 4:3 scene sits on the screen, one cell being one pixel wide and
+// two pixels tall.
+struct Viewport {
+	int x = 0;
+	int y = 0;
+	Canvas canvas{0, 0};
+
+	explicit Viewport(const Screen &screen) {
+		const int height = std::min(2 * screen.rows(), screen.cols() * 3 / 4) & ~1;
+		const int width = height * 4 / 3;
+		x = (screen.cols() - width) / 2;
+		y = (screen.rows() - height / 2) / 2;
+		canvas = Canvas(width, height);
+	}
+};
+
+enum class Mode {
+	Menu,
+	Playing,
+	End,
+	Quitting,
+};
+
+struct Options {
+	bool bot = false;
+	bool truecolor = false;
+	int stream_port = 0;
+	const char *watch = nullptr;
+	const char *watch_state = nullptr;
+	int game = 0;
+};
+
+// The game on the headless simulation: one EnvBatch lane stepped at a fixed
+// 60 Hz, so terminal games play by the same rules as recorded replays.
+class Game final {
+private:
+	static constexpr const char *WELCOME_TEXT = "Welcome to Flappy Dragon";
+	static constexpr const char *FLAP_TEXT = "Press SPACE to flap";
+	static constexpr const char *PLAY_GAME = "(P) Play Game";
+	static constexpr const char *PLAY_AGAIN = "(P) Play Again";
+	static constexpr const char *QUIT_GAME = "(Q) Quit Game";
+	static constexpr const char *YOU_ARE_DEAD_TEXT = "You're Dead!";
+
+	Mode mode_;
+	bool bot_;
+	std::vector<char> memory_;
+	Arena arena_;
+	std::optional<EnvBatch> batch_;
+	std::random_device random_;
+	// Terminals report key presses, not releases, so every space is one flap:
+	// the same edge the windowed game takes from IsKeyDown(KEY_SPACE).
+	bool flap_ = false;
+	int score_ = 0;
+
+	static EnvOptions options(std::uint32_t seed) {
+		EnvOptions opt;
+		opt.first_seed = seed;
+		opt.episodes = 1;
+		opt.slot_arena_bytes = 0;
+		return opt;
+	}
+
+	void restart() {
+		arena_.reset();
+		batch_.emplace(1, arena_, options(random_()));
+		flap_ = false;
+		score_ = 0;
+		mode_ = Mode::Playing;
+	}
+
+	static void centered(Screen &screen, const Viewport &view, int y, const char *s) {
+		screen.text(view.x + (view.canvas.width() - static_cast<int>(std::strlen(s))) / 2, y, s, RASTER_MAROON);
+	}
+public:
+	explicit Game(const Options &opt)
+		: mode_(opt.bot ? Mode::Playing : Mode::Menu), bot_(opt.bot),
+		  memory_(EnvBatch::memory_needed(1, options(0))), arena_(memory_.data(), memory_.size()) {
+		if (bot_) {
+			restart();
+		}
+	}
+
+	Mode mode() const { return mode_; }
+	int score() const { return score_; }
+
+	void on_key(char key) {
+		if (key == 'q' || key == 'Q' || key == 3) {
+			mode_ = Mode::Quitting;
+		} else if (mode_ == Mode::Playing) {
+			flap_ = flap_ || key == ' ';
+		} else if (key == 'p' || key == 'P') {
+			restart();
+		}
+	}
+
+	void tick() {
+		std::uint8_t flap = flap_;
+		if (bot_) {
+			heuristic_bot(*batch_, &flap);
+		}
+		flap_ = false;
+		batch_->step(&flap);
+		if (batch_->finished_count() != 0) {
+			score_ = batch_->finished()[0].score;
+			if (bot_) {
+				restart();
+			} else {
+				mode_ = Mode::End;
+			}
+		} else {
+			score_ = batch_->score()[0];
+		}
+	}
+
+	SceneState scene() const {
+		const EnvBatch &batch = *batch_;
+		return SceneState{batch.y()[0], batch.obstacle_x()[0] - batch.x()[0], batch.gap()[0], score_};
+	}
+
+	void draw(Screen &screen, Viewport &view) const {
+		Canvas &canvas = view.canvas;
+		screen.fill(BLACK);
+		if (mode_ != Mode::Playing) {
+			canvas.clear(RASTER_WHITE);
+			screen.blit(canvas, view.x, view.y);
+			int y = view.y + canvas.height() / 6;
+			centered(screen, view, y++, mode_ == Mode::End ? YOU_ARE_DEAD_TEXT : WELCOME_TEXT);
+			centered(screen, view, y++, mode_ == Mode::End ? PLAY_AGAIN : PLAY_GAME);
+			centered(screen, view, y++, QUIT_GAME);
+			return;
+		}
+
+		draw_world(canvas, scene());
+		screen.blit(canvas, view.x, view.y);
+
+		char score_buffer[32];
+		std::snprintf(score_buffer, sizeof(score_buffer), "Score: %d", score_);
+		screen.text(view.x + 1, view.y, FLAP_TEXT, RASTER_MAROON);
+		screen.text(view.x + 1, view.y + 1, score_buffer, RASTER_MAROON);
+	}
+};//~ Game
+
+// Bytes written to the terminal, for the report on exit.
+struct Traffic {
+	std::uint64_t bytes = 0;
+	std::uint64_t frames = 0;
+
+	// Returns false if the terminal went away.
+	bool send(Screen &screen) {
+		const std::string &out = screen.flush();
+		if (out.empty()) {
+			return true;
+		}
+		bytes += out.size();
+		frames += 1;
+		return write_all(out.data(), out.size());
+	}
+};
+
+// Re-reads the terminal size after a SIGWINCH; returns true if it changed.
+static bool check_resize(Screen &screen, std::optional<Viewport> &view) {
+	if (!RESIZED) {
+		return false;
+	}
+	RESIZED = 0;
+	int cols, rows;
+	if (!Terminal::size(cols, rows)) {
+		return false;
+	}
+	screen.resize(cols, rows);
+	view.emplace(screen);
+	return true;
+}
+
+static void play(const Options &opt, Screen &screen, Traffic &traffic, FrameStream *stream) {
+	using Clock = std::chrono::steady_clock;
+	Game game(opt);
+	std::optional<Viewport> view;
+	auto next_tick = Clock::now();
+	bool dirty = true;
+	while (game.mode() != Mode::Quitting && !HANGUP) {
+		dirty = check_resize(screen, view) || dirty;
+		if (dirty && view) {
+			game.draw(screen, *view);
+			if (!traffic.send(screen)) {
+				break;
+			}
+			if (stream) {
+				if (game.mode() == Mode::Playing) {
+					draw_scene(stream->canvas(), game.scene());
+				}
+				stream->publish();
+			}
+			dirty = false;
+		}
+
+		// Sleep until the next tick or a key; menus sleep until a key unless
+		// spectators need serving.
+		const bool playing = game.mode() == Mode::Playing;
+		int timeout = -1;
+		if (playing || stream) {
+			const auto wait = std::chrono::ceil<std::chrono::milliseconds>(next_tick - Clock::now());
+			timeout = std::max<int>(0, wait.count());
+		}
+		pollfd in = { STDIN_FILENO, POLLIN, 0 };
+		if (poll(&in, 1, timeout) > 0) {
+			char keys[64];
+			const ssize_t n = read(STDIN_FILENO, keys, sizeof(keys));
+			for (ssize_t k = 0; k < n; ++k) {
+				game.on_key(keys[k]);
+			}
+			dirty = true;
+		}
+
+		const auto now = Clock::now();
+		for (int i = 0; i < MAX_TICKS_PER_FRAME && now >= next_tick; ++i) {
+			if (game.mode() == Mode::Playing) {
+				game.tick();
+			}
+			next_tick += TICK;
+			dirty = true;
+		}
+		// a stalled link drops ticks instead of fast-forwarding afterwards
+		if (now >= next_tick) {
+			next_tick = now + TICK;
+		}
+	}
+}
+
+static int connect_to(const char *address) {
+	const char *colon = std::strrchr(address, ':');
+	if (!colon) {
+		std::fprintf(stderr, "%s: expected HOST:PORT\n", address);
+		return -1;
+	}
+	const std::string host(address, colon);
+	addrinfo hints{};
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	addrinfo *found = nullptr;
+	if (const int err = getaddrinfo(host.c_str(), colon + 1, &hints, &found); err != 0) {
+		std::fprintf(stderr, "%s: %s\n", address, gai_strerror(err));
+		return -1;
+	}
+	int fd = -1;
+	for (addrinfo *a = found; a && fd < 0; a = a->ai_next) {
+		fd = socket(a->ai_family, a->ai_socktype | SOCK_CLOEXEC, a->ai_protocol);
+		if (fd >= 0 && connect(fd, a->ai_addr, a->ai_addrlen) != 0) {
+			close(fd);
+			fd = -1;
+		}
+	}
+	freeaddrinfo(found);
+	if (fd < 0) {
+		std::fprintf(stderr, "%s: cannot connect\n", address);
+	}
+	return fd;
+}
+
+static std::uint32_t get32(const std::uint8_t *p) {
+	return p[0] | p[1] << 8 | p[2] << 16 | static_cast<std::uint32_t>(p[3]) << 24;
+}
+
+static std::uint16_t get16(const std::uint8_t *p) {
+	return p[0] | p[1] << 8;
+}
+
+// Nearest-neighbour copy of `from` over all of `to`.
+static void scale_into(const Canvas &from, Canvas &to) {
+	for (int y = 0; y < to.height(); ++y) {
+		const Rgb *src = from.row(y * from.height() / to.height());
+		Rgb *dst = to.row(y);
+		for (int x = 0; x < to.width(); ++x) {
+			dst[x] = src[x * from.width() / to.width()];
+		}
+	}
+}
+
+// Shows the frames a `--stream` server sends. Every complete frame that has
+// arrived is applied before the screen is redrawn, so a slow terminal skips
+// frames rather than falling behind the game.
+static bool watch(const char *address, Screen &screen, Traffic &traffic) {
+	const int fd = connect_to(address);
+	if (fd < 0) {
+		return false;
+	}
+	std::vector<std::uint8_t> in;
+	std::size_t parsed = 0;
+	std::optional<Canvas> frame;
+	std::optional<Viewport> view;
+	bool dirty = false;
+	bool ok = true;
+	bool quit = false;
+	while (!quit && !HANGUP) {
+		dirty = check_resize(screen, view) || dirty;
+		if (dirty && view && frame) {
+			screen.fill(BLACK);
+			scale_into(*frame, view->canvas);
+			screen.blit(view->canvas, view->x, view->y);
+			if (!traffic.send(screen)) {
+				break;
+			}
+			dirty = false;
+		}
+
+		pollfd fds[2] = { { STDIN_FILENO, POLLIN, 0 }, { fd, POLLIN, 0 } };
+		if (poll(fds, 2, -1) <= 0) {
+			continue;
+		}
+		if (fds[0].revents & POLLIN) {
+			char keys[64];
+			const ssize_t n = read(STDIN_FILENO, keys, sizeof(keys));
+			for (ssize_t k = 0; k < n; ++k) {
+				quit = quit || keys[k] == 'q' || keys[k] == 'Q' || keys[k] == 3;
+			}
+		}
+		if (!(fds[1].revents & (POLLIN | POLLHUP | POLLERR))) {
+			continue;
+		}
+
+		const std::size_t size = in.size();
+		in.resize(size + 64 * 1024);
+		const ssize_t n = recv(fd, in.data() + size, 64 * 1024, 0);
+		in.resize(size + std::max<ssize_t>(n, 0));
+		if (n <= 0) {
+			break;
+		}
+
+		if (!frame) {
+			if (in.size() < STREAM_HEADER_BYTES) {
+				continue;
+			}
+			if (std::memcmp(in.data(), STREAM_MAGIC, sizeof(STREAM_MAGIC)) != 0 || in[8] != STREAM_TILE) {
+				ok = false;
+				break;
+			}
+			frame.emplace(get16(&in[4]), get16(&in[6]));
+			frame->clear(RASTER_WHITE);
+			parsed = STREAM_HEADER_BYTES;
+		}
+		while (in.size() - parsed >= 4 && in.size() - parsed - 4 >= get32(&in[parsed])) {
+			const std::uint8_t *p = &in[parsed];
+			const std::uint8_t *end = p + 4 + get32(p);
+			if (end - p < static_cast<std::ptrdiff_t>(STREAM_FRAME_HEADER_BYTES)) {
+				ok = false;
+				break;
+			}
+			const int tiles = get16(p + 8);
+			p += STREAM_FRAME_HEADER_BYTES;
+			for (int t = 0; t < tiles && p; ++t) {
+				p = end - p >= 2 ? decode_stream_tile(*frame, get16(p), p + 2, end) : nullptr;
+			}
+			if (!p) {
+				ok = false;
+				break;
+			}
+			parsed = end - in.data();
+			dirty = true;
+		}
+		if (!ok) {
+			break;
+		}
+		in.erase(in.begin(), in.begin() + parsed);
+		parsed = 0;
+	}
+	close(fd);
+	if (!ok) {
+		std::fprintf(stderr, "%s: not a frame stream\n", address);
+	}
+	return ok;
+}
+
+// Draws the games a flappy_spectate server sends. The scene is rebuilt from
+// the last state received; `[` and `]` switch to another game.
+static bool watch_state(const char *address, int game, Screen &screen, Traffic &traffic) {
+	const int fd = connect_to(address);
+	if (fd < 0) {
+		return false;
+	}
+	auto subscribe = [&] {
+		const std::uint8_t request[4] = { static_cast<std::uint8_t>(game), static_cast<std::uint8_t>(game >> 8),
+			static_cast<std::uint8_t>(game >> 16), static_cast<std::uint8_t>(game >> 24) };
+		return send(fd, request, sizeof(request), MSG_NOSIGNAL) == sizeof(request);
+	};
+	std::vector<std::uint8_t> in;
+	int games = -1;
+	SpectatorView view;
+	std::optional<Viewport> viewport;
+	bool dirty = false;
+	bool ok = subscribe();
+	bool quit = false;
+	while (ok && !quit && !HANGUP) {
+		dirty = check_resize(screen, viewport) || dirty;
+		if (dirty && viewport) {
+			screen.fill(BLACK);
+			Canvas &canvas = viewport->canvas;
+			canvas.clear(RASTER_WHITE);
+			if (view.valid) {
+				const SpectatorState state = view.state();
+				draw_world(canvas, SceneState{state.y, state.pipe_x, state.gap, state.score});
+			}
+			screen.blit(canvas, viewport->x, viewport->y);
+			char status[64];
+			std::snprintf(status, sizeof(status), "Game %d of %d   Score: %d", game, std::max(games, 0), view.score);
+			screen.text(viewport->x + 1, viewport->y, status, RASTER_MAROON);
+			if (!traffic.send(screen)) {
+				break;
+			}
+			dirty = false;
+		}
+
+		pollfd fds[2] = { { STDIN_FILENO, POLLIN, 0 }, { fd, POLLIN, 0 } };
+		if (poll(fds, 2, -1) <= 0) {
+			continue;
+		}
+		if (fds[0].revents & POLLIN) {
+			char keys[64];
+			const ssize_t n = read(STDIN_FILENO, keys, sizeof(keys));
+			for (ssize_t k = 0; k < n; ++k) {
+				quit = quit || keys[k] == 'q' || keys[k] == 'Q' || keys[k] == 3;
+				if (games > 0 && (keys[k] == '[' || keys[k] == ']')) {
+					game = (game + (keys[k] == ']' ? 1 : games - 1)) % games;
+					view.valid = false;
+					ok = subscribe();
+					dirty = true;
+				}
+			}
+		}
+		if (!(fds[1].revents & (POLLIN | POLLHUP | POLLERR))) {
+			continue;
+		}
+
+		const std::size_t size = in.size();
+		in.resize(size + 16 * 1024);
+		const ssize_t n = recv(fd, in.data() + size, 16 * 1024, 0);
+		in.resize(size + std::max<ssize_t>(n, 0));
+		if (n <= 0) {
+			break;
+		}
+
+		std::size_t parsed = 0;
+		if (games < 0) {
+			if (in.size() < 6) {
+				continue;
+			}
+			if (std::memcmp(in.data(), STATE_MAGIC, sizeof(STATE_MAGIC)) != 0) {
+				ok = false;
+				break;
+			}
+			games = get16(&in[4]);
+			parsed = 6;
+		}
+		// whole chunks only; a chunk is one tick of the subscribed game
+		while (in.size() - parsed >= 2 && in.size() - parsed - 2 >= get16(&in[parsed])) {
+			const std::uint8_t *p = &in[parsed + 2];
+			const std::uint8_t *end = p + get16(&in[parsed]);
+			while (p && p != end) {
+				p = view.apply(p, end);
+			}
+			if (!p) {
+				ok = false;
+				break;
+			}
+			parsed = end - in.data();
+			dirty = true;
+		}
+		in.erase(in.begin(), in.begin() + parsed);
+	}
+	close(fd);
+	if (!ok) {
+		std::fprintf(stderr, "%s: not a state stream\n", address);
+	}
+	return ok;
+}
+
+static void usage(const char *argv0) {
+	std::fprintf(stderr, "usage: %s [--bot] [--truecolor] [--stream PORT | --watch HOST:PORT | --watch-state HOST:PORT [--game N]]\n", argv0);
+	std::exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv) {
+	Options opt;
+	for (int i = 1; i < argc; ++i) {
+		if (std::strcmp(argv[i], "--bot") == 0) {
+			opt.bot = true;
+		} else if (std::strcmp(argv[i], "--truecolor") == 0) {
+			opt.truecolor = true;
+		} else if (std::strcmp(argv[i], "--stream") == 0 && i + 1 < argc) {
+			opt.stream_port = std::atoi(argv[++i]);
+		} else if (std::strcmp(argv[i], "--watch") == 0 && i + 1 < argc) {
+			opt.watch = argv[++i];
+		} else if (std::strcmp(argv[i], "--watch-state") == 0 && i + 1 < argc) {
+			opt.watch_state = argv[++i];
+		} else if (std::strcmp(argv[i], "--game") == 0 && i + 1 < argc) {
+			opt.game = std::atoi(argv[++i]);
+		} else {
+			usage(argv[0]);
+		}
+	}
+	if ((opt.watch != nullptr) + (opt.watch_state != nullptr) + (opt.stream_port != 0) > 1 || opt.game < 0) {
+		usage(argv[0]);
+	}
+	if (!isatty(STDIN_FILENO) || !isatty(STDOUT_FILENO)) {
+		std::fprintf(stderr, "%s: needs a terminal\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	std::optional<FrameStream> stream;
+	if (opt.stream_port != 0) {
+		stream.emplace(SCREEN_WIDTH, SCREEN_HEIGHT);
+		if (!stream->listen(opt.stream_port)) {
+			return EXIT_FAILURE;
+		}
+	}
+
+	// no SA_RESTART, so these also wake the poll below
+	struct sigaction action{};
+	action.sa_handler = [](int) { RESIZED = 1; };
+	sigaction(SIGWINCH, &action, nullptr);
+	action.sa_handler = [](int) { HANGUP = 1; };
+	sigaction(SIGHUP, &action, nullptr);
+	sigaction(SIGTERM, &action, nullptr);
+
+	Screen screen(opt.truecolor);
+	Traffic traffic;
+	bool ok = true;
+	const auto start = std::chrono::steady_clock::now();
+	{
+		Terminal terminal;
+		if (opt.watch) {
+			ok = watch(opt.watch, screen, traffic);
+		} else if (opt.watch_state) {
+			ok = watch_state(opt.watch_state, opt.game, screen, traffic);
+		} else {
+			play(opt, screen, traffic, stream ? &*stream : nullptr);
+		}
+	}
+
+	const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	std::printf("%llu frames sent, %.0f bytes/frame, %.1f KB/s\n", static_cast<unsigned long long>(traffic.frames),
+		traffic.frames ? static_cast<double>(traffic.bytes) / traffic.frames : 0.0, traffic.bytes / seconds / 1024.0);
+	if (stream) {
+		std::printf("stream: %d spectators, %.1f KB/s sent, %llu frames dropped\n", stream->clients(),
+			stream->bytes_sent() / seconds / 1024.0, static_cast<unsigned long long>(stream->frames_dropped()));
+	}
+	return ok ? 0 : EXIT_FAILURE;
+}
@@ -0,0 +1,315 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "arena.hpp"
+#include "bots.hpp"
+#include "env.hpp"
+#include "eval_cache.hpp"
+#include "rules.hpp"
+#include "work_stealing.hpp"
+
+// Round-robin tournaments: every bot plays every seed, and bots are compared
+// seed by seed. The birds of all bots fly one seed together, in one batch on
+// one shared course, so its pipes are generated once. Games go through the
+// evaluation cache like the sweep's; the birds are independent, so a seed
+// replays only the bots whose games are missing.
+
+static constexpr char RESULTS_MAGIC[4] = { 'F', 'L', 'T', 'R' };
+static constexpr std::uint32_t RESULTS_VERSION = 1;
+
+// from safe to sloppy, so the default rules and tick cap separate them
+static constexpr const char *DEFAULT_BOTS[] = {
+	"heuristic:40", "heuristic:75", "heuristic:80", "heuristic:85", "predict:8", "predict:9",
+};
+
+struct Options {
+	std::vector<const char *> bots;
+	int seeds = 1000;
+	std::uint32_t seed = 1;
+	std::uint32_t max_ticks = 3 * 60 * 60;
+	const char *rules = nullptr;
+	int threads = static_cast<int>(std::thread::hardware_concurrency());
+	const char *cache = "evals";
+	const char *out = nullptr;
+};
+
+struct BotSummary {
+	double mean;
+	double mean_ticks;
+	std::int32_t p10;
+	std::int32_t p50;
+	std::int32_t p90;
+	std::int32_t max;
+	std::uint32_t truncated;
+};
+
+// Results are kept bot-major, games[bot * seeds + seed], the layout of the file.
+struct Tournament {
+	std::vector<BotSpec> bots;
+	std::vector<const char *> names;
+	int seeds;
+	std::uint32_t first_seed;
+	Rules rules;
+	std::uint64_t rules_key;
+	std::vector<EvalResult> games;
+
+	EvalResult &game(int bot, int seed) { return games[static_cast<std::size_t>(bot) * seeds + seed]; }
+	const EvalResult &game(int bot, int seed) const { return games[static_cast<std::size_t>(bot) * seeds + seed]; }
+	EvalKey key(int bot, int seed) const { return EvalKey{bots[bot].key(), rules_key, first_seed + seed}; }
+};
+
+// A seed to play and the bots missing a game on it.
+struct SeedGames {
+	int seed;
+	std::vector<int> bots;
+};
+
+// Plays one seed with the missing bots, environment i being bot bots[i].
+static void play_seed(Tournament &t, const SeedGames &games, const Options &opt) {
+	const int seed = games.seed;
+	const int count = games.bots.size();
+	thread_local std::vector<BotSpec> specs;
+	specs.resize(count);
+	for (int i = 0; i < count; ++i) {
+		specs[i] = t.bots[games.bots[i]];
+	}
+	EnvOptions env;
+	env.first_seed = t.first_seed + seed;
+	env.seed_stride = 0;
+	env.episodes = count;
+	env.slot_arena_bytes = 0;
+	env.rules = t.rules;
+	env.max_episode_ticks = opt.max_ticks;
+	env.share_course = true;
+	thread_local std::vector<char> memory;
+	memory.resize(EnvBatch::memory_needed(count, env) + count + Arena::CACHE_LINE);
+	Arena arena(memory.data(), memory.size());
+	EnvBatch batch(count, arena, env);
+	std::uint8_t *flap = arena.make_array<std::uint8_t>(count);
+	while (batch.live() != 0) {
+		mixed_bots(batch, flap, specs.data());
+		batch.step(flap);
+		for (int i = 0; i < batch.finished_count(); ++i) {
+			const EpisodeResult &r = batch.finished()[i];
+			t.game(games.bots[r.env], seed) = EvalResult{r.score, r.ticks, r.truncated};
+		}
+	}
+}
+
+static BotSummary summarize(const Tournament &t, int bot) {
+	BotSummary result = {};
+	std::vector<std::int32_t> scores(t.seeds);
+	double sum = 0.0;
+	double ticks = 0.0;
+	for (int s = 0; s < t.seeds; ++s) {
+		const EvalResult &game = t.game(bot, s);
+		scores[s] = game.score;
+		sum += game.score;
+		ticks += game.ticks;
+		result.truncated += game.truncated;
+	}
+	std::sort(scores.begin(), scores.end());
+	const auto quantile = [&](double q) { return scores[std::min<std::size_t>(q * scores.size(), scores.size() - 1)]; };
+	result.mean = sum / t.seeds;
+	result.mean_ticks = ticks / t.seeds;
+	result.p10 = quantile(0.1);
+	result.p50 = quantile(0.5);
+	result.p90 = quantile(0.9);
+	result.max = scores.back();
+	return result;
+}
+
+// Share of seeds on which bot a outscored bot b, ties counting half.
+static double win_rate(const Tournament &t, int a, int b) {
+	double wins = 0.0;
+	for (int s = 0; s < t.seeds; ++s) {
+		const std::int32_t sa = t.game(a, s).score;
+		const std::int32_t sb = t.game(b, s).score;
+		wins += sa > sb ? 1.0 : sa == sb ? 0.5 : 0.0;
+	}
+	return wins / t.seeds;
+}
+
+// Header, the bot names, then one column per field: seed[seeds], followed by
+// score, ticks and truncated, each [bots][seeds]. Native byte order.
+static bool write_results(const char *path, const Tournament &t, std::uint32_t max_ticks) {
+	std::FILE *out = std::fopen(path, "wb");
+	if (!out) {
+		std::perror(path);
+		return false;
+	}
+	const std::uint32_t header[] = { RESULTS_VERSION, static_cast<std::uint32_t>(t.bots.size()),
+		static_cast<std::uint32_t>(t.seeds), max_ticks };
+	std::fwrite(RESULTS_MAGIC, 1, sizeof(RESULTS_MAGIC), out);
+	std::fwrite(header, sizeof(header), 1, out);
+	std::fwrite(&t.rules_key, sizeof(t.rules_key), 1, out);
+	for (const char *name : t.names) {
+		std::fwrite(name, 1, std::strlen(name) + 1, out);
+	}
+
+	const std::size_t games = t.games.size();
+	std::vector<std::uint32_t> seeds(t.seeds);
+	for (int s = 0; s < t.seeds; ++s) {
+		seeds[s] = t.first_seed + s;
+	}
+	std::vector<std::int32_t> score(games);
+	std::vector<std::uint32_t> ticks(games);
+	std::vector<std::uint8_t> truncated(games);
+	for (std::size_t g = 0; g < games; ++g) {
+		score[g] = t.games[g].score;
+		ticks[g] = t.games[g].ticks;
+		truncated[g] = t.games[g].truncated;
+	}
+	std::fwrite(seeds.data(), sizeof(std::uint32_t), seeds.size(), out);
+	std::fwrite(score.data(), sizeof(std::int32_t), games, out);
+	std::fwrite(ticks.data(), sizeof(std::uint32_t), games, out);
+	std::fwrite(truncated.data(), 1, games, out);
+	if (std::ferror(out) | std::fclose(out)) {
+		std::fprintf(stderr, "%s: write failed\n", path);
+		return false;
+	}
+	return true;
+}
+
+static void usage(const char *argv0) {
+	std::fprintf(stderr, "usage: %s [--bot SPEC]... [--seeds N] [--seed N] [--max-ticks N] [--rules FILE]\n"
+		"       [--threads N] [--cache PATH | --no-cache] [--out FILE]\n"
+		"SPEC is heuristic:OFFSET or predict:TICKS\n", argv0);
+	std::exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv) {
+	Options opt;
+	for (int i = 1; i < argc; ++i) {
+		auto value = [&] {
+			if (i + 1 == argc) {
+				usage(argv[0]);
+			}
+			return argv[++i];
+		};
+		if (std::strcmp(argv[i], "--bot") == 0) {
+			opt.bots.push_back(value());
+		} else if (std::strcmp(argv[i], "--seeds") == 0) {
+			opt.seeds = std::atoi(value());
+		} else if (std::strcmp(argv[i], "--seed") == 0) {
+			opt.seed = std::strtoul(value(), nullptr, 10);
+		} else if (std::strcmp(argv[i], "--max-ticks") == 0) {
+			opt.max_ticks = std::strtoul(value(), nullptr, 10);
+		} else if (std::strcmp(argv[i], "--rules") == 0) {
+			opt.rules = value();
+		} else if (std::strcmp(argv[i], "--threads") == 0) {
+			opt.threads = std::atoi(value());
+		} else if (std::strcmp(argv[i], "--cache") == 0) {
+			opt.cache = value();
+		} else if (std::strcmp(argv[i], "--no-cache") == 0) {
+			opt.cache = nullptr;
+		} else if (std::strcmp(argv[i], "--out") == 0) {
+			opt.out = value();
+		} else {
+			usage(argv[0]);
+		}
+	}
+	if (opt.seeds < 1 || opt.threads < 1 || opt.max_ticks < 1) {
+		usage(argv[0]);
+	}
+	if (opt.bots.empty()) {
+		opt.bots.assign(std::begin(DEFAULT_BOTS), std::end(DEFAULT_BOTS));
+	}
+
+	Tournament t;
+	for (const char *name : opt.bots) {
+		BotSpec spec;
+		if (!BotSpec::parse(name, spec)) {
+			std::fprintf(stderr, "%s: not a bot\n", name);
+			usage(argv[0]);
+		}
+		t.bots.push_back(spec);
+		t.names.push_back(name);
+	}
+	t.seeds = opt.seeds;
+	t.first_seed = opt.seed;
+	if (opt.rules && !load_rules(opt.rules, t.rules)) {
+		return EXIT_FAILURE;
+	}
+	t.rules_key = rules_key(t.rules, opt.max_ticks);
+	t.games.resize(t.bots.size() * t.seeds);
+	const int bots = t.bots.size();
+
+	EvalCache cache;
+	if (opt.cache && !cache.open(opt.cache)) {
+		return EXIT_FAILURE;
+	}
+	// each seed is played with only the bots whose game on it is not cached
+	std::vector<SeedGames> to_play;
+	std::size_t missing = 0;
+	for (int s = 0; s < t.seeds; ++s) {
+		SeedGames games{s, {}};
+		for (int b = 0; b < bots; ++b) {
+			if (!cache.find(t.key(b, s), t.game(b, s))) {
+				games.bots.push_back(b);
+			}
+		}
+		if (!games.bots.empty()) {
+			missing += games.bots.size();
+			to_play.push_back(std::move(games));
+		}
+	}
+	std::fprintf(stderr, "%d bots x %d seeds, %zu games on %zu seeds to play on %d threads\n",
+		bots, t.seeds, missing, to_play.size(), opt.threads);
+
+	const auto start = std::chrono::steady_clock::now();
+	parallel_for_stealing(to_play.size(), opt.threads, [&](int i) { play_seed(t, to_play[i], opt); });
+	const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	if (cache.writable()) {
+		for (const SeedGames &games : to_play) {
+			for (int b : games.bots) {
+				cache.insert(t.key(b, games.seed), t.game(b, games.seed));
+			}
+		}
+	}
+	if (opt.out && !write_results(opt.out, t, opt.max_ticks)) {
+		return EXIT_FAILURE;
+	}
+
+	int width = 3;
+	for (const char *name : t.names) {
+		width = std::max<int>(width, std::strlen(name));
+	}
+	std::printf("%-*s %7s %4s %4s %4s %4s %8s %7s %7s\n", width, "bot", "mean", "p10", "p50", "p90", "max",
+		"ticks", "capped", "wins");
+	for (int b = 0; b < bots; ++b) {
+		const BotSummary s = summarize(t, b);
+		double wins = 0.0;
+		for (int o = 0; o < bots; ++o) {
+			wins += o == b ? 0.0 : win_rate(t, b, o);
+		}
+		std::printf("%-*s %7.2f %4d %4d %4d %4d %8.0f %6.1f%% %6.1f%%\n", width, t.names[b], s.mean, s.p10, s.p50,
+			s.p90, s.max, s.mean_ticks, 100.0 * s.truncated / t.seeds, bots > 1 ? 100.0 * wins / (bots - 1) : 0.0);
+	}
+
+	// head to head: row beat column on this share of seeds
+	std::printf("\n%-*s", width, "");
+	for (int o = 0; o < bots; ++o) {
+		std::printf(" %6d", o + 1);
+	}
+	std::printf("\n");
+	for (int b = 0; b < bots; ++b) {
+		std::printf("%-*s", width, t.names[b]);
+		for (int o = 0; o < bots; ++o) {
+			if (o == b) {
+				std::printf(" %6s", "-");
+			} else {
+				std::printf(" %5.1f%%", 100.0 * win_rate(t, b, o));
+			}
+		}
+		std::printf("  (%d)\n", b + 1);
+	}
+	std::fprintf(stderr, "played %zu games in %.1f s\n", missing, seconds);
+	return 0;
+}
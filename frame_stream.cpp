@@ -0,0 +1,270 @@
+#include "frame_stream.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static_assert(sizeof(Rgb) == 3);
+
+static void put16(std::vector<std::uint8_t> &out, std::uint16_t v) {
+	out.push_back(v & 0xff);
+	out.push_back(v >> 8);
+}
+
+static void put32(std::uint8_t *at, std::uint32_t v) {
+	for (int i = 0; i < 4; ++i) {
+		at[i] = (v >> (8 * i)) & 0xff;
+	}
+}
+
+// Pixel rectangle of a tile, clipped to the canvas.
+static void tile_rect(const Canvas &canvas, int tile, int &x, int &y, int &w, int &h) {
+	const int tiles_x = (canvas.width() + STREAM_TILE - 1) / STREAM_TILE;
+	x = tile % tiles_x * STREAM_TILE;
+	y = tile / tiles_x * STREAM_TILE;
+	w = std::min(STREAM_TILE, canvas.width() - x);
+	h = std::min(STREAM_TILE, canvas.height() - y);
+}
+
+const std::uint8_t *decode_stream_tile(Canvas &canvas, int tile, const std::uint8_t *data, const std::uint8_t *end) {
+	const int tiles_x = (canvas.width() + STREAM_TILE - 1) / STREAM_TILE;
+	const int tiles_y = (canvas.height() + STREAM_TILE - 1) / STREAM_TILE;
+	if (tile < 0 || tile >= tiles_x * tiles_y) {
+		return nullptr;
+	}
+	int x, y, w, h;
+	tile_rect(canvas, tile, x, y, w, h);
+	int i = 0;
+	while (i < w * h) {
+		if (end - data < 4 || data[0] == 0 || data[0] > w * h - i) {
+			return nullptr;
+		}
+		const Rgb color = { data[1], data[2], data[3] };
+		for (int n = data[0]; n > 0; --n, ++i) {
+			canvas.row(y + i % h)[x + i / h] = color;
+		}
+		data += 4;
+	}
+	return data;
+}
+
+FrameStream::FrameStream(int width, int height)
+	: tiles_x_((width + STREAM_TILE - 1) / STREAM_TILE), tiles_y_((height + STREAM_TILE - 1) / STREAM_TILE),
+	  draft_(width, height), current_(width, height), changed_(tiles_x_ * tiles_y_),
+	  encoded_(tiles_x_ * tiles_y_), encoded_frame_(tiles_x_ * tiles_y_, ~std::uint32_t{0}) {
+	draft_.clear(RASTER_WHITE);
+	current_.clear(RASTER_WHITE);
+}
+
+FrameStream::~FrameStream() {
+	for (const Client &client : clients_) {
+		close(client.fd);
+	}
+	if (listen_fd_ >= 0) {
+		close(listen_fd_);
+	}
+}
+
+bool FrameStream::listen(int port) {
+	listen_fd_ = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (listen_fd_ < 0) {
+		std::fprintf(stderr, "stream: socket: %s\n", std::strerror(errno));
+		return false;
+	}
+	const int on = 1;
+	setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+	sockaddr_in addr{};
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	addr.sin_port = htons(port);
+	if (bind(listen_fd_, reinterpret_cast<const sockaddr *>(&addr), sizeof(addr)) != 0
+		|| ::listen(listen_fd_, 16) != 0) {
+		std::fprintf(stderr, "stream: port %d: %s\n", port, std::strerror(errno));
+		close(listen_fd_);
+		listen_fd_ = -1;
+		return false;
+	}
+	return true;
+}
+
+void FrameStream::accept_clients() {
+	if (listen_fd_ < 0) {
+		return;
+	}
+	for (;;) {
+		const int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (fd < 0) {
+			return;
+		}
+		const int on = 1;
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+		// the header goes out now, the whole frame with the next publish()
+		Client client{fd, nullptr, {}, 0, std::vector<std::uint8_t>(changed_.size(), 1), true};
+		client.own.assign(STREAM_MAGIC, STREAM_MAGIC + sizeof(STREAM_MAGIC));
+		put16(client.own, current_.width());
+		put16(client.own, current_.height());
+		client.own.push_back(STREAM_TILE);
+		clients_.push_back(std::move(client));
+		send_pending(clients_.back());
+	}
+}
+
+bool FrameStream::tile_changed(int tile) const {
+	int x, y, w, h;
+	tile_rect(current_, tile, x, y, w, h);
+	for (int j = y; j < y + h; ++j) {
+		if (std::memcmp(draft_.row(j) + x, current_.row(j) + x, w * sizeof(Rgb)) != 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+const std::vector<std::uint8_t> &FrameStream::encoded_tile(int tile) {
+	std::vector<std::uint8_t> &out = encoded_[tile];
+	if (encoded_frame_[tile] == frame_) {
+		return out;
+	}
+	encoded_frame_[tile] = frame_;
+	out.clear();
+	int x, y, w, h;
+	tile_rect(current_, tile, x, y, w, h);
+	int run = 0;
+	Rgb color{};
+	for (int i = x; i < x + w; ++i) {
+		for (int j = y; j < y + h; ++j) {
+			const Rgb pixel = current_.row(j)[i];
+			if (run != 0 && (pixel != color || run == 255)) {
+				out.insert(out.end(), { static_cast<std::uint8_t>(run), color.r, color.g, color.b });
+				run = 0;
+			}
+			color = pixel;
+			run += 1;
+		}
+	}
+	out.insert(out.end(), { static_cast<std::uint8_t>(run), color.r, color.g, color.b });
+	return out;
+}
+
+void FrameStream::append_frame(std::vector<std::uint8_t> &out, const std::vector<std::uint8_t> &tiles, int count) {
+	const std::size_t start = out.size();
+	out.resize(start + 8);
+	put32(out.data() + start + 4, frame_);
+	put16(out, count);
+	for (int t = 0; t < static_cast<int>(tiles.size()); ++t) {
+		if (tiles[t]) {
+			put16(out, t);
+			const std::vector<std::uint8_t> &runs = encoded_tile(t);
+			out.insert(out.end(), runs.begin(), runs.end());
+		}
+	}
+	put32(out.data() + start, out.size() - start - 4);
+}
+
+FrameStream::Delta *FrameStream::build_delta() {
+	auto spare = std::find_if(deltas_.begin(), deltas_.end(), [](const auto &d) { return d->readers == 0; });
+	if (spare == deltas_.end()) {
+		deltas_.push_back(std::make_unique<Delta>());
+		spare = deltas_.end() - 1;
+	}
+	Delta &delta = **spare;
+	delta.bytes.clear();
+	append_frame(delta.bytes, changed_, changed_count_);
+	return &delta;
+}
+
+void FrameStream::release(Client &client) {
+	if (client.delta) {
+		client.delta->readers -= 1;
+		client.delta = nullptr;
+	}
+	client.own.clear();
+	client.sent = 0;
+}
+
+bool FrameStream::send_pending(Client &client) {
+	const std::vector<std::uint8_t> &out = client.out();
+	while (client.sent < out.size()) {
+		const ssize_t n = send(client.fd, out.data() + client.sent, out.size() - client.sent,
+			MSG_NOSIGNAL | MSG_DONTWAIT);
+		if (n < 0) {
+			return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+		}
+		client.sent += n;
+		bytes_sent_ += n;
+	}
+	// spectators never send anything, so a readable socket means it closed
+	char byte;
+	const ssize_t n = recv(client.fd, &byte, 1, MSG_DONTWAIT);
+	return n < 0 ? errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR : n != 0;
+}
+
+void FrameStream::publish() {
+	accept_clients();
+	frame_ += 1;
+
+	changed_count_ = 0;
+	for (int t = 0; t < static_cast<int>(changed_.size()); ++t) {
+		changed_[t] = tile_changed(t);
+		if (changed_[t]) {
+			changed_count_ += 1;
+			int x, y, w, h;
+			tile_rect(current_, t, x, y, w, h);
+			for (int j = y; j < y + h; ++j) {
+				std::memcpy(current_.row(j) + x, draft_.row(j) + x, w * sizeof(Rgb));
+			}
+		}
+	}
+
+	// built for the first client that kept up, then shared
+	Delta *delta = nullptr;
+	for (std::size_t c = 0; c < clients_.size();) {
+		Client &client = clients_[c];
+		if (changed_count_ != 0) {
+			for (std::size_t t = 0; t < changed_.size(); ++t) {
+				client.stale[t] |= changed_[t];
+			}
+		}
+
+		if (client.sent < client.out().size()) {
+			if (changed_count_ != 0) {
+				frames_dropped_ += 1;
+				client.behind = true;
+			}
+		} else {
+			release(client);
+			if (!client.behind) {
+				if (changed_count_ != 0) {
+					if (!delta) {
+						delta = build_delta();
+					}
+					client.delta = delta;
+					delta->readers += 1;
+				}
+			} else {
+				const int count = std::count(client.stale.begin(), client.stale.end(), 1);
+				if (count != 0) {
+					append_frame(client.own, client.stale, count);
+				}
+				client.behind = false;
+			}
+			std::fill(client.stale.begin(), client.stale.end(), 0);
+		}
+
+		if (send_pending(client)) {
+			c += 1;
+		} else {
+			release(client);
+			close(client.fd);
+			clients_[c] = std::move(clients_.back());
+			clients_.pop_back();
+		}
+	}
+}
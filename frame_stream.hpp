@@ -0,0 +1,108 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "raster.hpp"
+
+// Streams a canvas to spectators over TCP as deltas of changed tiles.
+//
+// Wire format, little endian. On connect the server sends "FLPY", u16 width,
+// u16 height and u8 tile size. Every frame after that is a u32 byte count of
+// the rest of the frame, u32 frame number and u16 tile count, followed by the
+// tiles: u16 tile index (row-major), then the tile's pixels as runs of u8
+// length and r, g, b. Tiles are scanned column by column, top to bottom, so
+// the vertical edges of pipes take one or two runs per tile. Edge tiles are
+// clipped to the canvas.
+static constexpr char STREAM_MAGIC[4] = { 'F', 'L', 'P', 'Y' };
+static constexpr int STREAM_TILE = 16;
+static constexpr std::size_t STREAM_HEADER_BYTES = 9;
+static constexpr std::size_t STREAM_FRAME_HEADER_BYTES = 10;
+
+// Decodes one run-length coded tile into the canvas; returns the first byte
+// after it, or nullptr if the runs are malformed or end before `end`.
+const std::uint8_t *decode_stream_tile(Canvas &canvas, int tile, const std::uint8_t *data, const std::uint8_t *end);
+
+// The server side, driven entirely from the thread that draws: publish() is
+// the only call that touches the sockets, all of which are non-blocking.
+//
+// A client only gets a new frame once it has drained the previous one, so a
+// slow spectator drops frames instead of queueing them. Tiles that changed
+// while it was behind are remembered per client and sent together in its next
+// frame. Clients that kept up share one delta message per frame, and tiles are
+// encoded at most once per frame however many clients need them.
+class FrameStream final {
+private:
+	// A frame's delta, sent as is to every client that kept up. It stays
+	// alive until the last of them has drained it, so a slow client can still
+	// be sending one while the next frame's is built.
+	struct Delta {
+		std::vector<std::uint8_t> bytes;
+		int readers = 0;
+	};
+
+	struct Client {
+		int fd;
+		// the shared delta being sent, or null while sending own
+		Delta *delta = nullptr;
+		// the header and catch-up frames, which only this client needs
+		std::vector<std::uint8_t> own;
+		std::size_t sent = 0;
+		// tiles whose current version the client has not been sent
+		std::vector<std::uint8_t> stale;
+		// stale holds more than the last frame's changes
+		bool behind = true;
+
+		const std::vector<std::uint8_t> &out() const { return delta ? delta->bytes : own; }
+	};
+
+	int listen_fd_ = -1;
+	int tiles_x_;
+	int tiles_y_;
+	Canvas draft_;
+	Canvas current_;
+	std::vector<std::uint8_t> changed_;
+	int changed_count_ = 0;
+	// run-length coded tiles of current_, valid where encoded_frame_ == frame_
+	std::vector<std::vector<std::uint8_t>> encoded_;
+	std::vector<std::uint32_t> encoded_frame_;
+	// deltas in flight and spare ones, reused once no client reads them
+	std::vector<std::unique_ptr<Delta>> deltas_;
+	std::uint32_t frame_ = 0;
+	std::vector<Client> clients_;
+	std::uint64_t bytes_sent_ = 0;
+	std::uint64_t frames_dropped_ = 0;
+
+	void accept_clients();
+	bool tile_changed(int tile) const;
+	const std::vector<std::uint8_t> &encoded_tile(int tile);
+	void append_frame(std::vector<std::uint8_t> &out, const std::vector<std::uint8_t> &tiles, int count);
+	Delta *build_delta();
+	// Drops what the client has finished sending.
+	void release(Client &client);
+	// Returns false once the client is gone.
+	bool send_pending(Client &client);
+public:
+	FrameStream(int width, int height);
+	~FrameStream();
+	FrameStream(const FrameStream&) = delete;
+	FrameStream& operator=(const FrameStream&) = delete;
+
+	// Listens on all interfaces; prints the reason and returns false on failure.
+	bool listen(int port);
+
+	// The frame to publish next. It keeps its pixels across publish() calls,
+	// so a static screen need not be redrawn.
+	Canvas &canvas() { return draft_; }
+
+	// Sends what canvas() now shows to every client that is ready for it and
+	// accepts new clients.
+	void publish();
+
+	int clients() const { return clients_.size(); }
+	std::uint64_t bytes_sent() const { return bytes_sent_; }
+	// frames not sent to a client because it was still draining an older one
+	std::uint64_t frames_dropped() const { return frames_dropped_; }
+};//~ FrameStream
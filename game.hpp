@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstdint>
+#include <random>
+
+// Rules shared by the windowed game and the headless simulation.
+
+static constexpr int SCREEN_WIDTH = 800;
+static constexpr int SCREEN_HEIGHT = 600;
+static constexpr int GAP_SIZE = SCREEN_HEIGHT / 3;
+static constexpr int PLAYER_RADIUS = 15;
+static constexpr int PLAYER_START_X = 5;
+static constexpr int OBSTACLE_WIDTH = SCREEN_WIDTH / 20;
+static constexpr int GROUND_HEIGHT = 15;
+
+static constexpr float DRAGON_MASS = 1.0;
+static constexpr float HORIZONTAL_VELOCITY = 120.0;
+static constexpr float GRAV_ACCELERATION = 600.0;
+static constexpr float FLAP_FORCE = -20000.0;
+
+// The headless simulation always advances by this step.
+static constexpr float SIM_DT = 1.0f / 60.0f;
+
+// splitmix64's finalizer. minstd's first outputs barely move between nearby
+// seeds, so episodes on consecutive seeds would otherwise fly nearly the same
+// course.
+inline std::uint64_t mix_seed(std::uint64_t seed) {
+	seed += 0x9e3779b97f4a7c15u;
+	seed = (seed ^ (seed >> 30)) * 0xbf58476d1ce4e5b9u;
+	seed = (seed ^ (seed >> 27)) * 0x94d049bb133111ebu;
+	return seed ^ (seed >> 31);
+}
+
+// minstd, seeded through mix_seed(), so every seed starts an unrelated stream.
+class Rng final : public std::minstd_rand0 {
+private:
+	static result_type mixed(std::uint64_t seed) { return mix_seed(seed) % modulus; }
+public:
+	Rng() : Rng(default_seed) {}
+	explicit Rng(std::uint64_t seed) : std::minstd_rand0(mixed(seed)) {}
+
+	void seed(std::uint64_t seed) { std::minstd_rand0::seed(mixed(seed)); }
+};//~ Rng
+
+// Center of the next obstacle gap. Both front-ends draw from a seeded engine
+// through this function, so a seed fully determines the obstacle stream.
+static constexpr int GAP_MIN = SCREEN_HEIGHT / 9;
+static constexpr int GAP_MAX = (SCREEN_HEIGHT * 8) / 10;
+
+inline int next_gap(Rng &rng, int min = GAP_MIN, int max = GAP_MAX) {
+	std::uniform_int_distribution<int> u(min, max);
+	return u(rng);
+}
+
+// The tunable rules. The defaults are the constants above, which replays
+// assume; the windowed game can load others from a file and sweeps vary them.
+struct Rules {
+	float horizontal_velocity = HORIZONTAL_VELOCITY;
+	float gravity = GRAV_ACCELERATION;
+	float flap_force = FLAP_FORCE;
+	int gap_size = GAP_SIZE;
+	int gap_min = GAP_MIN;
+	int gap_max = GAP_MAX;
+};
+
+inline bool circle_hits_rect(float cx, float cy, float radius, float rx, float ry, float rw, float rh) {
+	const float nx = cx < rx ? rx : (cx > rx + rw ? rx + rw : cx);
+	const float ny = cy < ry ? ry : (cy > ry + rh ? ry + rh : cy);
+	const float dx = cx - nx;
+	const float dy = cy - ny;
+	return dx * dx + dy * dy <= radius * radius;
+}
+
+inline bool obstacle_hit(float px, float py, float ox, float gap, float size) {
+	const float half_size = size / 2.0f;
+	return circle_hits_rect(px, py, PLAYER_RADIUS, ox, 0.0f, OBSTACLE_WIDTH, gap - half_size) ||
+	       circle_hits_rect(px, py, PLAYER_RADIUS, ox, gap + half_size, OBSTACLE_WIDTH, SCREEN_HEIGHT - gap - half_size);
+}
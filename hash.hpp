@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+// 64-bit FNV-1a, for content keys of things like rules and bot settings.
+// Values are fed one by one rather than as whole structs, so padding never
+// leaks into a key.
+class Hasher final {
+private:
+	std::uint64_t h_ = 0xcbf29ce484222325ull;
+public:
+	Hasher &bytes(const void *data, std::size_t size) {
+		const unsigned char *p = static_cast<const unsigned char *>(data);
+		for (std::size_t i = 0; i < size; ++i) {
+			h_ = (h_ ^ p[i]) * 0x100000001b3ull;
+		}
+		return *this;
+	}
+
+	template <typename T>
+	Hasher &add(T value) {
+		static_assert(std::is_arithmetic_v<T>);
+		return bytes(&value, sizeof(value));
+	}
+
+	Hasher &add(const char *text) { return bytes(text, std::strlen(text) + 1); }
+
+	std::uint64_t value() const { return h_; }
+};//~ Hasher
@@ -0,0 +1,81 @@
+#include "input.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include "replay.hpp"
+
+ScriptedInput::ScriptedInput(std::vector<InputEvent> events) : events_(std::move(events)) {
+	std::stable_sort(events_.begin(), events_.end(),
+		[](const InputEvent &a, const InputEvent &b) { return a.time < b.time; });
+}
+
+bool ScriptedInput::load(const char *path, std::vector<InputEvent> &events) {
+	std::FILE *file = std::fopen(path, "r");
+	if (!file) {
+		std::fprintf(stderr, "%s: cannot open\n", path);
+		return false;
+	}
+	char line[256];
+	bool ok = true;
+	for (int number = 1; ok && std::fgets(line, sizeof(line), file); ++number) {
+		if (char *comment = std::strchr(line, '#')) {
+			*comment = '\0';
+		}
+		double time;
+		char action[16];
+		const int fields = std::sscanf(line, "%lf %15s", &time, action);
+		if (fields <= 0) {
+			continue;
+		}
+		if (fields == 2 && std::strcmp(action, "flap") == 0) {
+			events.push_back(InputEvent{time, Action::Flap});
+		} else if (fields == 2 && std::strcmp(action, "play") == 0) {
+			events.push_back(InputEvent{time, Action::Play});
+		} else if (fields == 2 && std::strcmp(action, "quit") == 0) {
+			events.push_back(InputEvent{time, Action::Quit});
+		} else {
+			std::fprintf(stderr, "%s:%d: expected SECONDS flap|play|quit\n", path, number);
+			ok = false;
+		}
+	}
+	std::fclose(file);
+	return ok;
+}
+
+bool ScriptedInput::load_replay(const char *path, std::vector<InputEvent> &events, std::uint32_t &seed) {
+	ReplayFile replay(path);
+	if (!replay.valid()) {
+		std::fprintf(stderr, "%s: not a replay\n", path);
+		return false;
+	}
+	const ReplayHeader &h = replay.header();
+	seed = h.seed;
+	// play goes in on tick 0, so tick n of the episode is tick n of the run
+	events.push_back(InputEvent{tick_time(0), Action::Play});
+	for (std::uint32_t i = 0; i < h.flap_count; ++i) {
+		events.push_back(InputEvent{tick_time(replay.flaps()[i]), Action::Flap});
+	}
+	events.push_back(InputEvent{tick_time(h.ticks + 1), Action::Quit});
+	return true;
+}
+
+void ScriptedInput::poll(double now, const InputView &, InputQueue &queue) {
+	while (next_ < events_.size() && events_[next_].time <= now && queue.push(events_[next_])) {
+		next_ += 1;
+	}
+}
+
+void BotInput::poll(double now, const InputView &view, InputQueue &queue) {
+	if (view.playing) {
+		if (view.y > view.gap + offset_ && view.vy > 0.0f) {
+			queue.push(InputEvent{now, Action::Flap});
+		}
+	} else if (episodes_ > 0) {
+		queue.push(InputEvent{now, Action::Play});
+		episodes_ -= 1;
+	} else {
+		queue.push(InputEvent{now, Action::Quit});
+	}
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "game.hpp"
+
+// Player input as a queue of timestamped actions. Sources push events stamped
+// on the game clock; the game pops the ones that are due at each simulation
+// tick. Live devices, replays and scripted bots all go through the same
+// queue, so a scripted run of the windowed game plays exactly like a live one.
+
+enum class Action : std::uint8_t {
+	Flap,
+	Play,
+	Quit,
+};
+
+struct InputEvent {
+	double time;
+	Action action;
+	// `time` is when the press happened, not just when a frame polled it
+	bool precise = false;
+};
+
+// What sources may look at when deciding; bots need the bird and the gap.
+struct InputView {
+	bool playing;
+	float y;
+	float vy;
+	float gap;
+};
+
+// Fixed-capacity FIFO, so queuing input never allocates.
+class InputQueue final {
+private:
+	static constexpr int CAPACITY = 256;
+
+	InputEvent events_[CAPACITY];
+	int head_ = 0;
+	int count_ = 0;
+public:
+	// Returns false, dropping the event, when the queue is full.
+	bool push(const InputEvent &event) {
+		if (count_ == CAPACITY) {
+			return false;
+		}
+		events_[(head_ + count_) % CAPACITY] = event;
+		count_ += 1;
+		return true;
+	}
+
+	// Takes the oldest event stamped no later than `now`.
+	bool pop(double now, InputEvent &event) {
+		if (count_ == 0 || events_[head_].time > now) {
+			return false;
+		}
+		event = events_[head_];
+		head_ = (head_ + 1) % CAPACITY;
+		count_ -= 1;
+		return true;
+	}
+};//~ InputQueue
+
+class InputSource {
+public:
+	virtual ~InputSource() = default;
+
+	// Queues whatever happened up to `now`. Called once per frame.
+	virtual void poll(double now, const InputView &view, InputQueue &queue) = 0;
+
+	// Sources that need no player; these runs use a fixed time step.
+	virtual bool scripted() const { return false; }
+};
+
+// Tick `tick` of a fixed-step run, on the same clock scripted events use.
+inline double tick_time(std::uint64_t tick) {
+	return tick * static_cast<double>(SIM_DT);
+}
+
+// Plays a list of events given up front.
+class ScriptedInput final : public InputSource {
+private:
+	std::vector<InputEvent> events_;
+	std::size_t next_ = 0;
+public:
+	explicit ScriptedInput(std::vector<InputEvent> events);
+
+	// A text file of "SECONDS flap|play|quit" lines; `#` starts a comment.
+	// Prints the offending line and returns false on errors.
+	static bool load(const char *path, std::vector<InputEvent> &events);
+
+	// Plays the replay at `path` from the menu: play, its flaps, then quit
+	// one tick after the recorded death. Sets `seed` to the replay's seed.
+	static bool load_replay(const char *path, std::vector<InputEvent> &events, std::uint32_t &seed);
+
+	void poll(double now, const InputView &view, InputQueue &queue) override;
+	bool scripted() const override { return true; }
+};//~ ScriptedInput
+
+// The reference bot rule: flap once the bird sinks `offset` below the gap
+// center while falling. Starts `episodes` games, then quits.
+class BotInput final : public InputSource {
+private:
+	int episodes_;
+	float offset_;
+public:
+	explicit BotInput(int episodes, float offset = 40.0f) : episodes_(episodes), offset_(offset) {}
+
+	void poll(double now, const InputView &view, InputQueue &queue) override;
+	bool scripted() const override { return true; }
+};//~ BotInput
@@ -0,0 +1,70 @@
+#include "particles.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <numbers>
+
+std::size_t Particles::memory_needed(int capacity) {
+	return capacity * (7 * sizeof(float) + sizeof(std::uint32_t)) + 8 * Arena::CACHE_LINE;
+}
+
+Particles::Particles(Arena &memory, int capacity)
+	: capacity_(capacity),
+	  x_(memory.make_array<float>(capacity)),
+	  y_(memory.make_array<float>(capacity)),
+	  vx_(memory.make_array<float>(capacity)),
+	  vy_(memory.make_array<float>(capacity)),
+	  life_(memory.make_array<float>(capacity)),
+	  inverse_life_(memory.make_array<float>(capacity)),
+	  size_(memory.make_array<float>(capacity)),
+	  color_(memory.make_array<std::uint32_t>(capacity)) {}
+
+void Particles::emit(const Burst &burst, float x, float y, float vx, float vy, Rng &rng) {
+	constexpr float radians = std::numbers::pi_v<float> / 180.0f;
+	std::uniform_real_distribution<float> angle((burst.angle - burst.spread) * radians,
+		(burst.angle + burst.spread) * radians);
+	std::uniform_real_distribution<float> speed(burst.speed_min, burst.speed_max);
+	std::uniform_real_distribution<float> life(burst.life_min, burst.life_max);
+	const int end = std::min(capacity_, count_ + burst.count);
+	for (int i = count_; i < end; ++i) {
+		const float a = angle(rng);
+		const float s = speed(rng);
+		x_[i] = x;
+		y_[i] = y;
+		vx_[i] = vx + s * std::cos(a);
+		vy_[i] = vy + s * std::sin(a);
+		life_[i] = life(rng);
+		inverse_life_[i] = 1.0f / life_[i];
+		size_[i] = burst.size;
+		color_[i] = burst.color;
+	}
+	count_ = end;
+}
+
+void Particles::update(float dt, float gravity) {
+	const int n = count_;
+	for (int i = 0; i < n; ++i) {
+		vy_[i] += gravity * dt;
+		x_[i] += vx_[i] * dt;
+		y_[i] += vy_[i] * dt;
+		life_[i] -= dt;
+	}
+
+	// swap-remove; the moved-in particle is checked again at the same index
+	int i = 0;
+	while (i < count_) {
+		if (life_[i] > 0.0f) {
+			i += 1;
+			continue;
+		}
+		const int last = --count_;
+		x_[i] = x_[last];
+		y_[i] = y_[last];
+		vx_[i] = vx_[last];
+		vy_[i] = vy_[last];
+		life_[i] = life_[last];
+		inverse_life_[i] = inverse_life_[last];
+		size_[i] = size_[last];
+		color_[i] = color_[last];
+	}
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "arena.hpp"
+#include "game.hpp"
+
+// A spray of particles from one point.
+struct Burst {
+	int count;
+	// degrees, 0 pointing right and 90 down; particles leave within +-spread
+	float angle;
+	float spread;
+	float speed_min;
+	float speed_max;
+	// seconds
+	float life_min;
+	float life_max;
+	float size;
+	// RGBA, red in the low byte
+	std::uint32_t color;
+};
+
+// Fixed-capacity pool of short-lived particles, kept as structure-of-arrays in
+// arena memory so updates vectorize and nothing is allocated per particle.
+// Live particles are [0, count()); a particle that expires is replaced by the
+// last one, so the pool stays dense and is drawn in one pass.
+class Particles final {
+private:
+	int capacity_ = 0;
+	int count_ = 0;
+	float *x_ = nullptr;
+	float *y_ = nullptr;
+	float *vx_ = nullptr;
+	float *vy_ = nullptr;
+	// seconds left, and one over the seconds it started with
+	float *life_ = nullptr;
+	float *inverse_life_ = nullptr;
+	float *size_ = nullptr;
+	std::uint32_t *color_ = nullptr;
+public:
+	static std::size_t memory_needed(int capacity);
+
+	Particles() = default;
+	Particles(Arena &memory, int capacity);
+
+	// Spawns the burst at (x, y) moving along with (vx, vy). What does not fit
+	// is dropped.
+	void emit(const Burst &burst, float x, float y, float vx, float vy, Rng &rng);
+
+	// Moves every particle under `gravity` and removes the expired ones.
+	void update(float dt, float gravity);
+
+	void clear() { count_ = 0; }
+
+	int count() const { return count_; }
+	int capacity() const { return capacity_; }
+	const float *x() const { return x_; }
+	const float *y() const { return y_; }
+	const float *size() const { return size_; }
+	const std::uint32_t *color() const { return color_; }
+	// Share of its life a particle has left, for fading out.
+	float fade(int i) const { return life_[i] * inverse_life_[i]; }
+};//~ Particles
@@ -0,0 +1,90 @@
+#include "raster.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+// 3x5 glyphs, top row in the high bits
+static constexpr std::uint16_t DIGITS[10] = {
+	0b111'101'101'101'111, 0b010'110'010'010'111, 0b111'001'111'100'111, 0b111'001'111'001'111,
+	0b101'101'111'001'001, 0b111'100'111'001'111, 0b111'100'111'101'111, 0b111'001'001'001'001,
+	0b111'101'111'101'111, 0b111'101'111'001'111,
+};
+
+// Pixels [first, last) whose centers lie in [from, to).
+static void covered(float from, float to, int limit, int &first, int &last) {
+	first = std::max(0, static_cast<int>(std::ceil(from - 0.5f)));
+	last = std::min(limit, static_cast<int>(std::ceil(to - 0.5f)));
+}
+
+void Canvas::clear(Rgb color) {
+	std::fill(pixels_.begin(), pixels_.end(), color);
+}
+
+void Canvas::fill_rect(float x, float y, float w, float h, Rgb color) {
+	int x0, x1, y0, y1;
+	covered(x, x + w, width_, x0, x1);
+	covered(y, y + h, height_, y0, y1);
+	if (x0 >= x1) {
+		return;
+	}
+	for (int j = y0; j < y1; ++j) {
+		Rgb *row = pixels_.data() + j * width_;
+		std::fill(row + x0, row + x1, color);
+	}
+}
+
+void Canvas::fill_circle(float cx, float cy, float radius, Rgb color) {
+	int y0, y1;
+	covered(cy - radius, cy + radius, height_, y0, y1);
+	for (int j = y0; j < y1; ++j) {
+		const float dy = j + 0.5f - cy;
+		const float half = std::sqrt(std::max(0.0f, radius * radius - dy * dy));
+		int x0, x1;
+		covered(cx - half, cx + half, width_, x0, x1);
+		if (x0 < x1) {
+			Rgb *row = pixels_.data() + j * width_;
+			std::fill(row + x0, row + x1, color);
+		}
+	}
+}
+
+void Canvas::draw_number(std::int32_t value, float x, float y, float pixel, Rgb color) {
+	char digits[12];
+	int count = 0;
+	std::uint32_t rest = value < 0 ? 0u - static_cast<std::uint32_t>(value) : value;
+	do {
+		digits[count++] = rest % 10;
+		rest /= 10;
+	} while (rest != 0);
+
+	for (int d = count - 1; d >= 0; --d, x += 4 * pixel) {
+		const std::uint16_t glyph = DIGITS[static_cast<int>(digits[d])];
+		for (int bit = 0; bit < 15; ++bit) {
+			if (glyph & (1 << (14 - bit))) {
+				fill_rect(x + (bit % 3) * pixel, y + (bit / 3) * pixel, pixel, pixel, color);
+			}
+		}
+	}
+}
+
+void draw_world(Canvas &canvas, const SceneState &scene) {
+	const float sx = static_cast<float>(canvas.width()) / SCREEN_WIDTH;
+	const float sy = static_cast<float>(canvas.height()) / SCREEN_HEIGHT;
+	const float half_gap = scene.gap_size / 2.0f;
+
+	// same order as State::on_play: pipes and ground cover the bird
+	canvas.clear(RASTER_WHITE);
+	canvas.fill_circle(PLAYER_RADIUS * sx, scene.y * sy, PLAYER_RADIUS * sx, RASTER_RED);
+	canvas.fill_rect(scene.pipe_x * sx, 0.0f, OBSTACLE_WIDTH * sx, (scene.gap - half_gap) * sy, RASTER_BLUE);
+	canvas.fill_rect(scene.pipe_x * sx, (scene.gap + half_gap) * sy, OBSTACLE_WIDTH * sx,
+		(SCREEN_HEIGHT - scene.gap - half_gap) * sy, RASTER_BLUE);
+	canvas.fill_rect(0.0f, (SCREEN_HEIGHT - GROUND_HEIGHT) * sy, SCREEN_WIDTH * sx, GROUND_HEIGHT * sy,
+		RASTER_DARKGREEN);
+}
+
+void draw_scene(Canvas &canvas, const SceneState &scene) {
+	const float sx = static_cast<float>(canvas.width()) / SCREEN_WIDTH;
+	const float sy = static_cast<float>(canvas.height()) / SCREEN_HEIGHT;
+	draw_world(canvas, scene);
+	canvas.draw_number(scene.score, 10.0f * sx, 10.0f * sy, 4.0f * sx, RASTER_MAROON);
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "game.hpp"
+
+// Software drawing of the game scene, for tools that run without a window.
+
+struct Rgb {
+	std::uint8_t r, g, b;
+
+	bool operator==(const Rgb &) const = default;
+};
+
+// the raylib palette colors the game uses
+static constexpr Rgb RASTER_WHITE = { 255, 255, 255 };
+static constexpr Rgb RASTER_BLUE = { 0, 121, 241 };
+static constexpr Rgb RASTER_DARKGREEN = { 0, 117, 44 };
+static constexpr Rgb RASTER_RED = { 230, 41, 55 };
+static constexpr Rgb RASTER_MAROON = { 190, 33, 55 };
+
+// What one frame of a game shows, in game coordinates.
+struct SceneState {
+	float y;
+	float pipe_x; // relative to the bird
+	float gap;
+	std::int32_t score;
+	float gap_size = GAP_SIZE;
+};
+
+class Canvas final {
+private:
+	int width_;
+	int height_;
+	std::vector<Rgb> pixels_;
+public:
+	Canvas(int width, int height) : width_(width), height_(height), pixels_(width * height) {}
+
+	int width() const { return width_; }
+	int height() const { return height_; }
+	const Rgb *pixels() const { return pixels_.data(); }
+	const Rgb *row(int y) const { return pixels_.data() + y * width_; }
+	Rgb *row(int y) { return pixels_.data() + y * width_; }
+
+	void clear(Rgb color);
+	// Shapes cover the pixels whose centers they contain, clipped to the canvas.
+	void fill_rect(float x, float y, float w, float h, Rgb color);
+	void fill_circle(float cx, float cy, float radius, Rgb color);
+	// Decimal digits from a 3x5 bitmap font, each font pixel `pixel` wide.
+	void draw_number(std::int32_t value, float x, float y, float pixel, Rgb color);
+};//~ Canvas
+
+// Draws the bird, pipe and ground the way the windowed game does, scaled to
+// the canvas.
+void draw_world(Canvas &canvas, const SceneState &scene);
+// draw_world() plus the score in the top left corner.
+void draw_scene(Canvas &canvas, const SceneState &scene);
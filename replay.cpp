@@ -0,0 +1,112 @@
+#include "replay.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <dirent.h>
+#include <fcntl.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+bool write_replay(const char *path, std::uint32_t seed, const std::uint32_t *flaps, std::uint32_t flap_count) {
+	std::vector<std::int16_t> track;
+	const EpisodeResult result = simulate_replay(seed, flaps, flap_count, [&](std::uint32_t tick, const EnvBatch &batch) {
+		if (tick % REPLAY_DECIMATION == 0) {
+			track.push_back(static_cast<std::int16_t>(std::clamp(batch.y()[0] * REPLAY_Y_SCALE, -32768.0f, 32767.0f)));
+		}
+	});
+
+	const ReplayHeader header{REPLAY_MAGIC, REPLAY_VERSION, seed, result.score, result.ticks,
+		flap_count, REPLAY_DECIMATION, static_cast<std::uint32_t>(track.size())};
+	std::FILE *f = std::fopen(path, "wb");
+	if (!f) {
+		std::perror(path);
+		return false;
+	}
+	bool ok = std::fwrite(&header, sizeof(header), 1, f) == 1;
+	ok = ok && std::fwrite(flaps, sizeof(*flaps), flap_count, f) == flap_count;
+	ok = ok && std::fwrite(track.data(), sizeof(track[0]), track.size(), f) == track.size();
+	ok = std::fclose(f) == 0 && ok;
+	if (!ok) {
+		std::perror(path);
+	}
+	return ok;
+}
+
+ReplayFile::ReplayFile(const char *path) {
+	const int fd = ::open(path, O_RDONLY);
+	if (fd < 0) {
+		return;
+	}
+	struct stat st;
+	if (fstat(fd, &st) == 0 && static_cast<std::size_t>(st.st_size) >= sizeof(ReplayHeader)) {
+		void *p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (p != MAP_FAILED) {
+			map_ = p;
+			size_ = st.st_size;
+		}
+	}
+	::close(fd);
+
+	if (map_) {
+		const ReplayHeader &h = header();
+		const std::size_t expected = sizeof(ReplayHeader) + std::size_t{h.flap_count} * sizeof(std::uint32_t)
+			+ std::size_t{h.track_count} * sizeof(std::int16_t);
+		if (h.magic != REPLAY_MAGIC || h.version != REPLAY_VERSION || h.decimation == 0 || size_ != expected) {
+			munmap(map_, size_);
+			map_ = nullptr;
+			size_ = 0;
+		}
+	}
+}
+
+ReplayFile::~ReplayFile() {
+	if (map_) {
+		munmap(map_, size_);
+	}
+}
+
+ReplayFile::ReplayFile(ReplayFile &&other) noexcept : map_(other.map_), size_(other.size_) {
+	other.map_ = nullptr;
+	other.size_ = 0;
+}
+
+ReplayFile& ReplayFile::operator=(ReplayFile &&other) noexcept {
+	std::swap(map_, other.map_);
+	std::swap(size_, other.size_);
+	return *this;
+}
+
+std::vector<ReplayFile> load_best_replays(const char *dir, int count, std::optional<std::uint32_t> seed) {
+	std::vector<ReplayFile> replays;
+	DIR *d = opendir(dir);
+	if (!d) {
+		return replays;
+	}
+	while (dirent *entry = readdir(d)) {
+		const std::string name = entry->d_name;
+		if (name.size() < 7 || name.compare(name.size() - 7, 7, ".replay") != 0) {
+			continue;
+		}
+		ReplayFile replay((std::string(dir) + "/" + name).c_str());
+		if (replay.valid() && (!seed || replay.header().seed == *seed)) {
+			replays.push_back(std::move(replay));
+		}
+	}
+	closedir(d);
+
+	std::sort(replays.begin(), replays.end(), [](const ReplayFile &a, const ReplayFile &b) {
+		return a.header().score != b.header().score ? a.header().score > b.header().score
+			: a.header().ticks > b.header().ticks;
+	});
+	if (!seed && !replays.empty()) {
+		const std::uint32_t best_seed = replays.front().header().seed;
+		replays.erase(std::remove_if(replays.begin(), replays.end(),
+			[&](const ReplayFile &r) { return r.header().seed != best_seed; }), replays.end());
+	}
+	if (static_cast<int>(replays.size()) > count) {
+		replays.erase(replays.begin() + count, replays.end());
+	}
+	return replays;
+}
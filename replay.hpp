@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include "env.hpp"
+
+// A replay file holds the seed and flap ticks of one episode, followed by the
+// bird height sampled every REPLAY_DECIMATION ticks. Ghosts read that track
+// straight from the mapped file instead of re-simulating the episode.
+//
+//   ReplayHeader | flap_count x u32 flap tick | track_count x i16 y * REPLAY_Y_SCALE
+static constexpr std::uint32_t REPLAY_MAGIC = 0x52504c46; // "FLPR"
+static constexpr std::uint32_t REPLAY_VERSION = 2;
+static constexpr std::uint32_t REPLAY_DECIMATION = 4;
+static constexpr float REPLAY_Y_SCALE = 16.0f;
+
+struct ReplayHeader {
+	std::uint32_t magic;
+	std::uint32_t version;
+	std::uint32_t seed;
+	std::int32_t score;
+	std::uint32_t ticks;
+	std::uint32_t flap_count;
+	std::uint32_t decimation;
+	std::uint32_t track_count;
+};
+
+// Plays an episode back from its flap ticks, calling on_tick(tick, batch) for
+// the starting position and after every step the bird survives. The episode
+// is lane 0 of the batch.
+template <typename F>
+EpisodeResult simulate_replay(std::uint32_t seed, const std::uint32_t *flaps, std::uint32_t flap_count, F &&on_tick) {
+	EnvOptions opt;
+	opt.first_seed = seed;
+	opt.episodes = 1;
+	opt.slot_arena_bytes = 0;
+	std::vector<char> memory(EnvBatch::memory_needed(1, opt));
+	Arena arena(memory.data(), memory.size());
+	EnvBatch batch(1, arena, opt);
+
+	on_tick(std::uint32_t{0}, batch);
+	std::uint32_t next = 0;
+	for (std::uint32_t tick = 1;; ++tick) {
+		std::uint8_t flap = next < flap_count && flaps[next] == tick;
+		next += flap;
+		batch.step(&flap);
+		if (batch.finished_count() != 0) {
+			return batch.finished()[0];
+		}
+		on_tick(tick, batch);
+	}
+}
+
+// Re-simulates the episode to build its track and writes the replay file.
+// Prints the reason and returns false on failure.
+bool write_replay(const char *path, std::uint32_t seed, const std::uint32_t *flaps, std::uint32_t flap_count);
+
+// Read-only mapping of a replay file; valid() is false if it could not be
+// opened or is not a replay.
+class ReplayFile final {
+private:
+	void *map_ = nullptr;
+	std::size_t size_ = 0;
+public:
+	explicit ReplayFile(const char *path);
+	~ReplayFile();
+	ReplayFile(ReplayFile &&other) noexcept;
+	ReplayFile& operator=(ReplayFile &&other) noexcept;
+
+	bool valid() const { return map_ != nullptr; }
+	const ReplayHeader &header() const { return *static_cast<const ReplayHeader *>(map_); }
+	const std::uint32_t *flaps() const {
+		return reinterpret_cast<const std::uint32_t *>(&header() + 1);
+	}
+	const std::int16_t *track() const {
+		return reinterpret_cast<const std::int16_t *>(flaps() + header().flap_count);
+	}
+
+	// Bird height at a fractional tick, interpolated between track samples;
+	// false once the recorded bird has died.
+	bool y_at(float tick, float &y) const {
+		const ReplayHeader &h = header();
+		if (tick < 0.0f) {
+			tick = 0.0f;
+		}
+		const float sample = tick / h.decimation;
+		const std::uint32_t i = static_cast<std::uint32_t>(sample);
+		if (i + 1 >= h.track_count) {
+			return false;
+		}
+		const float t = sample - i;
+		y = (track()[i] * (1.0f - t) + track()[i + 1] * t) / REPLAY_Y_SCALE;
+		return true;
+	}
+};
+
+// The `count` best replays in `dir`, best first. Only replays of `seed` are
+// considered; without one, the seed of the best replay in `dir` is used.
+std::vector<ReplayFile> load_best_replays(const char *dir, int count, std::optional<std::uint32_t> seed = {});
@@ -0,0 +1,129 @@
+#include "rules.hpp"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+bool load_rules(const char *path, Rules &rules) {
+	std::FILE *file = std::fopen(path, "r");
+	if (!file) {
+		std::fprintf(stderr, "%s: cannot open\n", path);
+		return false;
+	}
+	Rules loaded = rules;
+	char line[256];
+	bool ok = true;
+	for (int number = 1; ok && std::fgets(line, sizeof(line), file); ++number) {
+		if (char *comment = std::strchr(line, '#')) {
+			*comment = '\0';
+		}
+		char key[32];
+		double value;
+		const int fields = std::sscanf(line, " %31[a-z_] = %lf", key, &value);
+		if (fields <= 0) {
+			continue;
+		}
+		if (fields == 2 && std::strcmp(key, "horizontal_velocity") == 0 && value > 0.0) {
+			loaded.horizontal_velocity = value;
+		} else if (fields == 2 && std::strcmp(key, "gravity") == 0) {
+			loaded.gravity = value;
+		} else if (fields == 2 && std::strcmp(key, "flap_force") == 0) {
+			loaded.flap_force = value;
+		} else if (fields == 2 && std::strcmp(key, "gap_size") == 0 && value > 2 * PLAYER_RADIUS) {
+			loaded.gap_size = value;
+		} else if (fields == 2 && std::strcmp(key, "gap_min") == 0) {
+			loaded.gap_min = value;
+		} else if (fields == 2 && std::strcmp(key, "gap_max") == 0) {
+			loaded.gap_max = value;
+		} else {
+			std::fprintf(stderr, "%s:%d: expected KEY = VALUE with a known key and a sensible value\n", path, number);
+			ok = false;
+		}
+	}
+	std::fclose(file);
+	if (ok && !(0 <= loaded.gap_min && loaded.gap_min <= loaded.gap_max && loaded.gap_max <= SCREEN_HEIGHT)) {
+		std::fprintf(stderr, "%s: need 0 <= gap_min <= gap_max <= %d\n", path, SCREEN_HEIGHT);
+		ok = false;
+	}
+	if (ok) {
+		rules = loaded;
+	}
+	return ok;
+}
+
+RulesWatcher::~RulesWatcher() {
+	if (watcher_.joinable()) {
+		const std::uint64_t one = 1;
+		if (write(wake_fd_, &one, sizeof(one)) != sizeof(one)) {
+			std::perror("rules: wake watcher");
+		}
+		watcher_.join();
+	}
+	if (wake_fd_ >= 0) {
+		close(wake_fd_);
+	}
+	if (inotify_fd_ >= 0) {
+		close(inotify_fd_);
+	}
+}
+
+bool RulesWatcher::start(const char *path) {
+	Rules rules;
+	if (!load_rules(path, rules)) {
+		return false;
+	}
+	rules_.write_slot() = rules;
+	rules_.publish();
+
+	// Editors often save by writing a new file and renaming it over the old
+	// one, so watch the directory for the name rather than the file itself.
+	path_ = path;
+	const std::size_t slash = path_.rfind('/');
+	const std::string dir = slash == std::string::npos ? "." : slash == 0 ? "/" : path_.substr(0, slash);
+	name_ = slash == std::string::npos ? path_ : path_.substr(slash + 1);
+	inotify_fd_ = inotify_init1(IN_CLOEXEC);
+	wake_fd_ = eventfd(0, EFD_CLOEXEC);
+	if (inotify_fd_ < 0 || wake_fd_ < 0
+		|| inotify_add_watch(inotify_fd_, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+		std::perror("rules: inotify");
+		return false;
+	}
+	watcher_ = std::thread([this] { watch(); });
+	return true;
+}
+
+void RulesWatcher::watch() {
+	alignas(inotify_event) char buffer[4096];
+	pollfd fds[2] = { { inotify_fd_, POLLIN, 0 }, { wake_fd_, POLLIN, 0 } };
+	for (;;) {
+		if (poll(fds, 2, -1) < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			std::perror("rules: poll");
+			return;
+		}
+		if (fds[1].revents) {
+			return;
+		}
+		const ssize_t size = read(inotify_fd_, buffer, sizeof(buffer));
+		bool changed = false;
+		for (ssize_t at = 0; at < size;) {
+			const inotify_event *event = reinterpret_cast<const inotify_event *>(buffer + at);
+			changed |= event->len != 0 && name_ == event->name;
+			at += sizeof(inotify_event) + event->len;
+		}
+		// keys taken out of the file go back to their defaults
+		Rules rules;
+		if (changed && load_rules(path_.c_str(), rules)) {
+			rules_.write_slot() = rules;
+			rules_.publish();
+			std::fprintf(stderr, "%s: rules reloaded\n", path_.c_str());
+		}
+	}
+}
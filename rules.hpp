@@ -0,0 +1,39 @@
+#pragma once
+
+#include <string>
+#include <thread>
+
+#include "game.hpp"
+#include "triple_buffer.hpp"
+
+// Reads "key = value" lines over the defaults; `#` starts a comment. Keys are
+// the member names of Rules. Prints the offending line and returns false on
+// errors, leaving `rules` as it was.
+bool load_rules(const char *path, Rules &rules);
+
+// Loads a rules file and reloads it on a thread of its own whenever inotify
+// reports it written or replaced. The game takes the newest rules once per
+// tick through a triple buffer, so it never locks or allocates for them. A
+// file that fails to load keeps the previous rules.
+class RulesWatcher final {
+private:
+	std::string path_;
+	std::string name_;
+	int inotify_fd_ = -1;
+	int wake_fd_ = -1;
+	std::thread watcher_;
+	TripleBuffer<Rules> rules_;
+
+	void watch();
+public:
+	RulesWatcher() = default;
+	~RulesWatcher();
+	RulesWatcher(const RulesWatcher&) = delete;
+	RulesWatcher& operator=(const RulesWatcher&) = delete;
+
+	// Returns false if the first load or the watch fails.
+	bool start(const char *path);
+
+	// The newest rules; stays valid until the next call. Game thread only.
+	const Rules &current() { return rules_.read(); }
+};//~ RulesWatcher
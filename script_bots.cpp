@@ -0,0 +1,129 @@
+#include "script_bots.hpp"
+
+#include <new>
+#include <utility>
+
+FramePool::~FramePool() {
+	while (chunks_) {
+		Chunk *next = chunks_->next;
+		::operator delete(chunks_);
+		chunks_ = next;
+	}
+}
+
+void *FramePool::allocate(std::size_t size) {
+	const std::size_t c = (size + CLASS_BYTES - 1) / CLASS_BYTES;
+	if (c >= CLASSES) {
+		return ::operator new(size);
+	}
+	if (FreeFrame *frame = free_[c]) {
+		free_[c] = frame->next;
+		return frame;
+	}
+	void *frame = chunk_.allocate(c * CLASS_BYTES, CLASS_BYTES);
+	if (!frame) {
+		Chunk *chunk = static_cast<Chunk *>(::operator new(CHUNK_BYTES));
+		chunk->next = chunks_;
+		chunks_ = chunk;
+		chunk_ = Arena(chunk + 1, CHUNK_BYTES - sizeof(Chunk));
+		frame = chunk_.allocate(c * CLASS_BYTES, CLASS_BYTES);
+	}
+	return frame;
+}
+
+void FramePool::free(void *frame, std::size_t size) {
+	const std::size_t c = (size + CLASS_BYTES - 1) / CLASS_BYTES;
+	if (c >= CLASSES) {
+		::operator delete(frame);
+		return;
+	}
+	free_[c] = new (frame) FreeFrame{free_[c]};
+}
+
+std::size_t ScriptedBots::memory_needed(int size) {
+	return size * (sizeof(BotScript::Handle) + sizeof(Wake) + sizeof(std::uint32_t) + sizeof(float))
+		+ 4 * Arena::CACHE_LINE;
+}
+
+ScriptedBots::ScriptedBots(const EnvBatch &batch, Arena &memory, Factory make)
+	: batch_(batch), size_(batch.size()), make_(std::move(make)) {
+	script_ = memory.make_array<BotScript::Handle>(size_);
+	wake_ = memory.make_array<Wake>(size_);
+	wake_tick_ = memory.make_array<std::uint32_t>(size_);
+	wake_offset_ = memory.make_array<float>(size_);
+	for (int env = 0; env < size_; ++env) {
+		start(env);
+	}
+}
+
+ScriptedBots::~ScriptedBots() {
+	for (int env = 0; env < size_; ++env) {
+		script_[env].destroy();
+	}
+}
+
+void ScriptedBots::start(std::uint32_t env) {
+	if (script_[env]) {
+		script_[env].destroy();
+	}
+	script_[env] = make_(env).release();
+	// runs up to its first co_await in the first decide()
+	wake_[env] = Wake::TICK;
+	wake_tick_[env] = 0;
+}
+
+bool ScriptedBots::resume(std::uint32_t env, int lane) {
+	BotScript::promise_type &p = script_[env].promise();
+	p.bird = BirdView{batch_.y()[lane], batch_.vy()[lane], batch_.gap()[lane], batch_.ticks()[lane]};
+	p.flap = false;
+	script_[env].resume();
+	resumes_ += 1;
+	wake_[env] = p.wake;
+	wake_tick_[env] = batch_.ticks()[lane] + p.ticks;
+	wake_offset_[env] = p.offset;
+	return p.flap;
+}
+
+void ScriptedBots::decide(std::uint8_t *flap) {
+	const float *y = batch_.y();
+	const float *vy = batch_.vy();
+	const float *gap = batch_.gap();
+	const std::uint32_t *ticks = batch_.ticks();
+	const std::uint32_t *lane_env = batch_.lane_env();
+	const std::uint32_t *alive = batch_.alive();
+	for (int i = 0; i < batch_.live(); ++i) {
+		const std::uint32_t env = lane_env[i];
+		flap[i] = 0;
+		for (int n = 0; n < MAX_RESUMES_PER_TICK && alive[i]; ++n) {
+			bool fired;
+			switch (wake_[env]) {
+			case Wake::TICK:
+				fired = ticks[i] >= wake_tick_[env];
+				break;
+			case Wake::FALLING_BELOW:
+				fired = y[i] > gap[i] + wake_offset_[env] && vy[i] > 0.0f;
+				break;
+			case Wake::RISING_ABOVE:
+				fired = y[i] < gap[i] - wake_offset_[env] && vy[i] < 0.0f;
+				break;
+			default:
+				fired = false;
+				break;
+			}
+			if (!fired) {
+				break;
+			}
+			if (resume(env, i)) {
+				// a flap waits for the next tick anyway
+				flap[i] = 1;
+				break;
+			}
+		}
+	}
+}
+
+void ScriptedBots::restart_finished() {
+	for (int i = 0; i < batch_.finished_count(); ++i) {
+		start(batch_.finished()[i].env);
+	}
+}
@@ -0,0 +1,189 @@
+#pragma once
+
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+
+#include "arena.hpp"
+#include "env.hpp"
+
+// Bots written as C++20 coroutines that suspend until their bird is in some
+// state, instead of as state machines:
+//
+//	BotScript cautious(float offset) {
+//		for (;;) {
+//			co_await falling_below_gap(offset);
+//			co_await flap();
+//		}
+//	}
+//
+// ScriptedBots runs one script per environment of an EnvBatch. A script says
+// what it waits for, and the scheduler checks that condition in a flat loop
+// over the lanes; only scripts whose condition holds are resumed. Frames come
+// from a per-thread pool, so restarting a script when its episode ends does
+// not touch the heap.
+
+// The bird as a resumed script sees it.
+struct BirdView {
+	float y;
+	float vy;
+	float gap;
+	std::uint32_t ticks;
+};
+
+// Per-thread free lists of coroutine frames, by size class. Chunks are only
+// given back when the thread exits. A frame must be freed on the thread that
+// allocated it.
+class FramePool final {
+private:
+	static constexpr std::size_t CLASS_BYTES = 64;
+	static constexpr int CLASSES = 32;
+	static constexpr std::size_t CHUNK_BYTES = 256 * 1024;
+
+	struct FreeFrame {
+		FreeFrame *next;
+	};
+	struct Chunk {
+		Chunk *next;
+	};
+
+	FreeFrame *free_[CLASSES] = {};
+	Chunk *chunks_ = nullptr;
+	Arena chunk_;
+public:
+	FramePool() = default;
+	~FramePool();
+	FramePool(const FramePool&) = delete;
+	FramePool& operator=(const FramePool&) = delete;
+
+	static FramePool &local() {
+		thread_local FramePool pool;
+		return pool;
+	}
+
+	void *allocate(std::size_t size);
+	void free(void *frame, std::size_t size);
+};//~ FramePool
+
+// What a script waits for before it is resumed.
+enum class Wake : std::uint8_t {
+	// the episode has run `ticks` ticks
+	TICK,
+	// the bird has sunk more than `offset` below the gap center and is falling
+	FALLING_BELOW,
+	// the bird has risen more than `offset` above the gap center and is rising
+	RISING_ABOVE,
+	// the script has returned
+	NEVER,
+};
+
+class BotScript final {
+public:
+	struct promise_type {
+		Wake wake = Wake::TICK;
+		// ticks to wait for TICK, relative until the scheduler makes it absolute
+		std::uint32_t ticks = 0;
+		float offset = 0.0f;
+		bool flap = false;
+		BirdView bird = {};
+
+		BotScript get_return_object() { return BotScript(std::coroutine_handle<promise_type>::from_promise(*this)); }
+		std::suspend_always initial_suspend() noexcept { return {}; }
+		std::suspend_always final_suspend() noexcept { return {}; }
+		void return_void() { wake = Wake::NEVER; }
+		void unhandled_exception() { std::terminate(); }
+
+		static void *operator new(std::size_t size) { return FramePool::local().allocate(size); }
+		static void operator delete(void *frame, std::size_t size) { FramePool::local().free(frame, size); }
+	};
+
+	using Handle = std::coroutine_handle<promise_type>;
+private:
+	Handle handle_;
+public:
+	explicit BotScript(Handle handle) : handle_(handle) {}
+	BotScript(BotScript &&other) : handle_(other.release()) {}
+	BotScript(const BotScript&) = delete;
+	BotScript& operator=(const BotScript&) = delete;
+	~BotScript() {
+		if (handle_) {
+			handle_.destroy();
+		}
+	}
+
+	Handle release() {
+		const Handle h = handle_;
+		handle_ = nullptr;
+		return h;
+	}
+};//~ BotScript
+
+// co_await one of these; each resumes with the bird as it is then.
+struct BotAwait {
+	Wake wake;
+	std::uint32_t ticks;
+	float offset;
+	bool flap;
+	BotScript::promise_type *promise = nullptr;
+
+	bool await_ready() const noexcept { return false; }
+	void await_suspend(BotScript::Handle h) noexcept {
+		promise = &h.promise();
+		promise->wake = wake;
+		promise->ticks = ticks;
+		promise->offset = offset;
+		promise->flap = flap;
+	}
+	BirdView await_resume() const noexcept { return promise->bird; }
+};
+
+// Flaps this tick and resumes on the next.
+inline BotAwait flap() { return BotAwait{Wake::TICK, 1, 0.0f, true}; }
+// Resumes `ticks` ticks later, at least one.
+inline BotAwait wait_ticks(std::uint32_t ticks) { return BotAwait{Wake::TICK, ticks < 1 ? 1 : ticks, 0.0f, false}; }
+inline BotAwait falling_below_gap(float offset) { return BotAwait{Wake::FALLING_BELOW, 0, offset, false}; }
+inline BotAwait rising_above_gap(float offset) { return BotAwait{Wake::RISING_ABOVE, 0, offset, false}; }
+
+// One script per environment, restarted with every episode.
+class ScriptedBots final {
+public:
+	using Factory = std::function<BotScript(std::uint32_t env)>;
+
+	// a script may wait on a condition that already holds; it is resumed again
+	// within the same tick, this many times at most
+	static constexpr int MAX_RESUMES_PER_TICK = 4;
+
+	static std::size_t memory_needed(int size);
+
+	// Starts a script for every environment of `batch`.
+	ScriptedBots(const EnvBatch &batch, Arena &memory, Factory make);
+	~ScriptedBots();
+	ScriptedBots(const ScriptedBots&) = delete;
+	ScriptedBots& operator=(const ScriptedBots&) = delete;
+
+	// Resumes the scripts whose condition holds and fills flap for the live
+	// lanes. Call once before every step().
+	void decide(std::uint8_t *flap);
+
+	// Restarts the scripts of the episodes the last step() finished.
+	void restart_finished();
+
+	// Scripts resumed since construction.
+	std::uint64_t resumes() const { return resumes_; }
+private:
+	void start(std::uint32_t env);
+	bool resume(std::uint32_t env, int lane);
+
+	const EnvBatch &batch_;
+	int size_;
+	Factory make_;
+	std::uint64_t resumes_ = 0;
+
+	// by environment id
+	BotScript::Handle *script_;
+	Wake *wake_;
+	std::uint32_t *wake_tick_;
+	float *wake_offset_;
+};//~ ScriptedBots
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// Single-producer, single-consumer FIFO of at most N - 1 values, N a power of
+// two. Neither side ever waits: push() fails when the queue is full and pop()
+// when it is empty.
+template <typename T, std::uint32_t N>
+class SpscQueue final {
+private:
+	static_assert((N & (N - 1)) == 0, "N must be a power of two");
+
+	T slots_[N] = {};
+	// head_ is written by the consumer only, tail_ by the producer only
+	alignas(64) std::atomic<std::uint32_t> head_{0};
+	alignas(64) std::atomic<std::uint32_t> tail_{0};
+public:
+	bool push(const T &value) {
+		const std::uint32_t tail = tail_.load(std::memory_order_relaxed);
+		const std::uint32_t next = (tail + 1) & (N - 1);
+		if (next == head_.load(std::memory_order_acquire)) {
+			return false;
+		}
+		slots_[tail] = value;
+		tail_.store(next, std::memory_order_release);
+		return true;
+	}
+
+	bool pop(T &value) {
+		const std::uint32_t head = head_.load(std::memory_order_relaxed);
+		if (head == tail_.load(std::memory_order_acquire)) {
+			return false;
+		}
+		value = slots_[head];
+		head_.store((head + 1) & (N - 1), std::memory_order_release);
+		return true;
+	}
+};
@@ -0,0 +1,393 @@
+#include "state_stream.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+static std::int16_t quantize(float value, float scale) {
+	return static_cast<std::int16_t>(std::clamp(std::lround(value * scale), -32768l, 32767l));
+}
+
+static std::uint8_t *put_varint(std::uint8_t *out, std::int32_t value) {
+	std::uint32_t zigzag = (static_cast<std::uint32_t>(value) << 1) ^ static_cast<std::uint32_t>(value >> 31);
+	while (zigzag >= 0x80) {
+		*out++ = (zigzag & 0x7f) | 0x80;
+		zigzag >>= 7;
+	}
+	*out++ = zigzag;
+	return out;
+}
+
+static const std::uint8_t *get_varint(const std::uint8_t *data, const std::uint8_t *end, std::int32_t &value) {
+	std::uint32_t zigzag = 0;
+	for (int shift = 0; shift < 35; shift += 7) {
+		if (data == end) {
+			return nullptr;
+		}
+		const std::uint8_t byte = *data++;
+		zigzag |= static_cast<std::uint32_t>(byte & 0x7f) << shift;
+		if (!(byte & 0x80)) {
+			value = static_cast<std::int32_t>(zigzag >> 1) ^ -static_cast<std::int32_t>(zigzag & 1);
+			return data;
+		}
+	}
+	return nullptr;
+}
+
+template <typename T>
+static std::uint8_t *put_le(std::uint8_t *out, T value) {
+	const auto bits = static_cast<std::make_unsigned_t<T>>(value);
+	for (std::size_t i = 0; i < sizeof(T); ++i) {
+		*out++ = (bits >> (8 * i)) & 0xff;
+	}
+	return out;
+}
+
+template <typename T>
+static T get_le(const std::uint8_t *data) {
+	std::make_unsigned_t<T> bits = 0;
+	for (std::size_t i = 0; i < sizeof(T); ++i) {
+		bits |= static_cast<std::make_unsigned_t<T>>(data[i]) << (8 * i);
+	}
+	return static_cast<T>(bits);
+}
+
+const std::uint8_t *SpectatorView::apply(const std::uint8_t *data, const std::uint8_t *end) {
+	if (data == end) {
+		return nullptr;
+	}
+	const std::uint8_t flags = *data++;
+	if (flags == STATE_KEYFRAME) {
+		if (end - data < 16) {
+			return nullptr;
+		}
+		tick = get_le<std::uint32_t>(data);
+		y = get_le<std::int16_t>(data + 4);
+		vy = get_le<std::int16_t>(data + 6);
+		pipe_x = get_le<std::int16_t>(data + 8);
+		gap = get_le<std::uint16_t>(data + 10);
+		score = get_le<std::int32_t>(data + 12);
+		valid = true;
+		return data + 16;
+	}
+	if (flags & ~(STATE_Y | STATE_VY | STATE_PIPE | STATE_SPAWN | STATE_SCORE)) {
+		return nullptr;
+	}
+
+	std::int16_t *fields[] = { &y, &vy, &pipe_x };
+	for (int i = 0; i < 3; ++i) {
+		std::int32_t change;
+		if (flags & (1 << i)) {
+			if (!(data = get_varint(data, end, change))) {
+				return nullptr;
+			}
+			*fields[i] = static_cast<std::int16_t>(*fields[i] + change);
+		}
+	}
+	if (flags & STATE_SPAWN) {
+		if (end - data < 2) {
+			return nullptr;
+		}
+		gap = get_le<std::uint16_t>(data);
+		data += 2;
+	}
+	if (flags & STATE_SCORE) {
+		std::int32_t change;
+		if (!(data = get_varint(data, end, change))) {
+			return nullptr;
+		}
+		score += change;
+	}
+	tick += 1;
+	return data;
+}
+
+SpectatorState SpectatorView::state() const {
+	return SpectatorState{y / STATE_POSITION_SCALE, vy / STATE_VELOCITY_SCALE, pipe_x / STATE_POSITION_SCALE,
+		static_cast<float>(gap), score};
+}
+
+StateStream::StateStream(int games) : games_(games) {
+	for (Game &game : games_) {
+		game.log.resize(LOG_BYTES);
+	}
+}
+
+StateStream::~StateStream() {
+	for (const Client &client : clients_) {
+		if (client.fd >= 0) {
+			close(client.fd);
+		}
+	}
+	if (epoll_fd_ >= 0) {
+		close(epoll_fd_);
+	}
+	if (listen_fd_ >= 0) {
+		close(listen_fd_);
+	}
+}
+
+bool StateStream::listen(int port) {
+	listen_fd_ = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+	if (listen_fd_ < 0 || epoll_fd_ < 0) {
+		std::fprintf(stderr, "state stream: %s\n", std::strerror(errno));
+		return false;
+	}
+	const int on = 1;
+	setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+	sockaddr_in addr{};
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	addr.sin_port = htons(port);
+	if (bind(listen_fd_, reinterpret_cast<const sockaddr *>(&addr), sizeof(addr)) != 0
+		|| ::listen(listen_fd_, 256) != 0) {
+		std::fprintf(stderr, "state stream: port %d: %s\n", port, std::strerror(errno));
+		close(listen_fd_);
+		listen_fd_ = -1;
+		return false;
+	}
+	return true;
+}
+
+void StateStream::update(int index, const SpectatorState &state, bool new_episode) {
+	Game &game = games_[index];
+	SpectatorView now;
+	now.tick = game.tick++;
+	now.y = quantize(state.y, STATE_POSITION_SCALE);
+	now.vy = quantize(state.vy, STATE_VELOCITY_SCALE);
+	now.pipe_x = quantize(state.pipe_x, STATE_POSITION_SCALE);
+	now.gap = static_cast<std::uint16_t>(std::clamp(std::lround(state.gap), 0l, 65535l));
+	now.score = state.score;
+	now.valid = true;
+
+	// a keyframe supersedes whatever else this chunk holds, so it always
+	// starts its chunk and spectators can join there
+	constexpr std::size_t LONGEST_DELTA = 1 + 3 * 3 + 2 + 5;
+	if (new_episode || game.force_keyframe || game.since_keyframe >= KEYFRAME_TICKS
+		|| game.pending_size + LONGEST_DELTA > MAX_CHUNK) {
+		std::uint8_t *out = game.pending;
+		*out++ = STATE_KEYFRAME;
+		out = put_le(out, now.tick);
+		out = put_le(out, now.y);
+		out = put_le(out, now.vy);
+		out = put_le(out, now.pipe_x);
+		out = put_le(out, now.gap);
+		out = put_le(out, now.score);
+		game.pending_size = out - game.pending;
+		game.since_keyframe = 0;
+		game.force_keyframe = false;
+	} else {
+		const SpectatorView &last = game.last;
+		std::uint8_t *flags = game.pending + game.pending_size;
+		std::uint8_t *out = flags + 1;
+		*flags = 0;
+		const std::int16_t changes[] = {
+			static_cast<std::int16_t>(now.y - last.y),
+			static_cast<std::int16_t>(now.vy - last.vy),
+			static_cast<std::int16_t>(now.pipe_x - last.pipe_x),
+		};
+		for (int i = 0; i < 3; ++i) {
+			if (changes[i] != 0) {
+				*flags |= 1 << i;
+				out = put_varint(out, changes[i]);
+			}
+		}
+		if (now.gap != last.gap) {
+			*flags |= STATE_SPAWN;
+			out = put_le(out, now.gap);
+		}
+		if (now.score != last.score) {
+			*flags |= STATE_SCORE;
+			out = put_varint(out, now.score - last.score);
+		}
+		game.pending_size = out - game.pending;
+		game.since_keyframe += 1;
+	}
+	game.last = now;
+}
+
+void StateStream::append_log(Game &game, const std::uint8_t *data, std::size_t size) {
+	const std::size_t at = game.head % LOG_BYTES;
+	const std::size_t first = std::min(size, LOG_BYTES - at);
+	std::memcpy(game.log.data() + at, data, first);
+	std::memcpy(game.log.data(), data + first, size - first);
+	game.head += size;
+}
+
+void StateStream::accept_clients() {
+	if (listen_fd_ < 0) {
+		return;
+	}
+	for (;;) {
+		const int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (fd < 0) {
+			return;
+		}
+		const int on = 1;
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+		int slot;
+		if (!free_slots_.empty()) {
+			slot = free_slots_.back();
+			free_slots_.pop_back();
+		} else {
+			slot = clients_.size();
+			clients_.emplace_back();
+		}
+		epoll_event event{};
+		event.events = EPOLLIN;
+		event.data.u32 = slot;
+		if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) != 0) {
+			close(fd);
+			free_slots_.push_back(slot);
+			continue;
+		}
+
+		Client &client = clients_[slot];
+		client.fd = fd;
+		client.game = -1;
+		client.request_size = 0;
+		client.carry.reserve(MAX_CHUNK + 2);
+		client.carry.assign(STATE_MAGIC, STATE_MAGIC + sizeof(STATE_MAGIC));
+		std::uint8_t count[2];
+		put_le(count, static_cast<std::uint16_t>(games_.size()));
+		client.carry.insert(client.carry.end(), count, count + 2);
+		client_count_ += 1;
+	}
+}
+
+void StateStream::subscribe(Client &client, std::uint32_t index) {
+	if (index >= games_.size()) {
+		client.game = -1;
+		return;
+	}
+	const Game &game = games_[index];
+	client.game = index;
+	client.pos = game.has_keyframe ? game.keyframe : game.head;
+}
+
+void StateStream::drop(int slot) {
+	Client &client = clients_[slot];
+	close(client.fd);
+	client.fd = -1;
+	client.carry.clear();
+	free_slots_.push_back(slot);
+	client_count_ -= 1;
+}
+
+void StateStream::read_requests() {
+	if (epoll_fd_ < 0) {
+		return;
+	}
+	epoll_event events[256];
+	int ready;
+	do {
+		ready = epoll_wait(epoll_fd_, events, 256, 0);
+		for (int e = 0; e < ready; ++e) {
+			const int slot = events[e].data.u32;
+			Client &client = clients_[slot];
+			if (client.fd < 0) {
+				continue;
+			}
+			std::uint8_t bytes[64];
+			const ssize_t n = recv(client.fd, bytes, sizeof(bytes), MSG_DONTWAIT);
+			if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+				drop(slot);
+				continue;
+			}
+			for (ssize_t i = 0; i < n; ++i) {
+				client.request[client.request_size++] = bytes[i];
+				if (client.request_size == 4) {
+					subscribe(client, get_le<std::uint32_t>(client.request));
+					client.request_size = 0;
+				}
+			}
+		}
+	} while (ready == 256);
+}
+
+bool StateStream::send_pending(Client &client) {
+	Game *game = client.game >= 0 ? &games_[client.game] : nullptr;
+	if (game && game->has_keyframe && game->head - client.pos > LOG_BYTES / 2 && game->keyframe > client.pos) {
+		client.pos = game->keyframe;
+		skips_ += 1;
+	}
+
+	iovec iov[3];
+	int count = 0;
+	if (!client.carry.empty()) {
+		iov[count++] = { client.carry.data(), client.carry.size() };
+	}
+	if (game && client.pos < game->head) {
+		const std::size_t at = client.pos % LOG_BYTES;
+		const std::size_t size = game->head - client.pos;
+		const std::size_t first = std::min(size, LOG_BYTES - at);
+		iov[count++] = { game->log.data() + at, first };
+		if (size > first) {
+			iov[count++] = { game->log.data(), size - first };
+		}
+	}
+	if (count == 0) {
+		return true;
+	}
+	const ssize_t n = writev(client.fd, iov, count);
+	if (n < 0) {
+		return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+	}
+	bytes_sent_ += n;
+
+	const std::size_t from_carry = std::min<std::size_t>(n, client.carry.size());
+	client.carry.erase(client.carry.begin(), client.carry.begin() + from_carry);
+	if (!client.carry.empty() || !game) {
+		return true;
+	}
+
+	// Step over the chunks that went out whole and carry the rest of a cut
+	// one, so the client is always at a chunk boundary of its game's log.
+	const std::uint64_t sent_to = client.pos + (n - from_carry);
+	auto log_at = [&](std::uint64_t offset) { return game->log[offset % LOG_BYTES]; };
+	while (client.pos < sent_to) {
+		const std::uint64_t end = client.pos + 2 + (log_at(client.pos) | log_at(client.pos + 1) << 8);
+		for (std::uint64_t i = sent_to; i < end; ++i) {
+			client.carry.push_back(log_at(i));
+		}
+		client.pos = end;
+	}
+	return true;
+}
+
+void StateStream::flush() {
+	for (Game &game : games_) {
+		if (game.pending_size == 0) {
+			continue;
+		}
+		const std::uint64_t start = game.head;
+		std::uint8_t size[2];
+		put_le(size, static_cast<std::uint16_t>(game.pending_size));
+		append_log(game, size, 2);
+		append_log(game, game.pending, game.pending_size);
+		if (game.pending[0] == STATE_KEYFRAME) {
+			game.keyframe = start;
+			game.has_keyframe = true;
+		}
+		game.pending_size = 0;
+	}
+
+	accept_clients();
+	read_requests();
+	for (int slot = 0; slot < static_cast<int>(clients_.size()); ++slot) {
+		if (clients_[slot].fd >= 0 && !send_pending(clients_[slot])) {
+			drop(slot);
+		}
+	}
+}
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Streams the state of many games to spectators over TCP as quantized deltas,
+// for clients that draw the scene themselves. Far cheaper than FrameStream:
+// a tick of one game takes a handful of bytes.
+//
+// Wire format, little endian. A client sends a u32 game id to subscribe, and
+// may send another at any time to switch games. On connect the server sends
+// "FLPS" and a u16 game count. After that it sends chunks, each a u16 byte
+// count followed by the messages of one tick of the subscribed game:
+//   keyframe: u8 STATE_KEYFRAME, u32 tick, i16 y, i16 vy, i16 pipe x, u16 gap,
+//             i32 score
+//   delta:    u8 flags, then for each of y, vy and pipe x whose flag is set the
+//             zigzag varint change, then u16 gap if a pipe spawned, then the
+//             zigzag varint change of the score; one tick after the last message
+// y and pipe x (relative to the bird) are in 1/8 pixels, vy in 1/4 pixels/s.
+// The first chunk after subscribing starts with a keyframe.
+static constexpr char STATE_MAGIC[4] = { 'F', 'L', 'P', 'S' };
+static constexpr std::uint8_t STATE_KEYFRAME = 0x80;
+static constexpr std::uint8_t STATE_Y = 0x01;
+static constexpr std::uint8_t STATE_VY = 0x02;
+static constexpr std::uint8_t STATE_PIPE = 0x04;
+static constexpr std::uint8_t STATE_SPAWN = 0x08;
+static constexpr std::uint8_t STATE_SCORE = 0x10;
+static constexpr float STATE_POSITION_SCALE = 8.0f;
+static constexpr float STATE_VELOCITY_SCALE = 4.0f;
+
+// What a spectator sees of one game.
+struct SpectatorState {
+	float y;
+	float vy;
+	float pipe_x;
+	float gap;
+	std::int32_t score;
+};
+
+// The receiving side: applies one message to the state and returns the byte
+// after it, or nullptr if the message is malformed or runs past `end`.
+struct SpectatorView {
+	std::uint32_t tick = 0;
+	std::int16_t y = 0;
+	std::int16_t vy = 0;
+	std::int16_t pipe_x = 0;
+	std::uint16_t gap = 0;
+	std::int32_t score = 0;
+	bool valid = false;
+
+	const std::uint8_t *apply(const std::uint8_t *data, const std::uint8_t *end);
+	SpectatorState state() const;
+};
+
+// The server side, driven from the thread that steps the games: update() once
+// per tick and game, then flush() once per tick.
+//
+// Every game appends its chunks to one ring-buffer log, encoded once however
+// many spectators watch it. A spectator is only an offset into the log of the
+// game it subscribed to, and flush() hands it the bytes between that offset
+// and the end of the log with one writev(). A spectator that falls half a log
+// behind skips ahead to the latest keyframe; one that joins or switches games
+// starts there too. Keyframes are written every KEYFRAME_TICKS, so a late
+// joiner waits for none.
+class StateStream final {
+public:
+	static constexpr int KEYFRAME_TICKS = 120;
+	static constexpr std::size_t LOG_BYTES = 64 * 1024;
+private:
+	static constexpr std::size_t MAX_CHUNK = 256;
+
+	struct Game {
+		std::vector<std::uint8_t> log;
+		// absolute offsets; the log holds [head - LOG_BYTES, head)
+		std::uint64_t head = 0;
+		std::uint64_t keyframe = 0;
+		bool has_keyframe = false;
+		std::uint32_t tick = 0;
+		int since_keyframe = 0;
+		bool force_keyframe = true;
+		SpectatorView last;
+		// messages of the tick being built
+		std::uint8_t pending[MAX_CHUNK];
+		std::size_t pending_size = 0;
+	};
+
+	struct Client {
+		int fd = -1;
+		int game = -1;
+		std::uint64_t pos = 0;
+		// the unsent rest of a chunk cut short by a full socket
+		std::vector<std::uint8_t> carry;
+		std::uint8_t request[4];
+		int request_size = 0;
+	};
+
+	int listen_fd_ = -1;
+	int epoll_fd_ = -1;
+	std::vector<Game> games_;
+	// slots are reused, and the slot index is the epoll key
+	std::vector<Client> clients_;
+	std::vector<int> free_slots_;
+	int client_count_ = 0;
+	std::uint64_t bytes_sent_ = 0;
+	std::uint64_t skips_ = 0;
+
+	void append_log(Game &game, const std::uint8_t *data, std::size_t size);
+	void accept_clients();
+	void read_requests();
+	void subscribe(Client &client, std::uint32_t game);
+	void drop(int slot);
+	// Returns false once the client is gone.
+	bool send_pending(Client &client);
+public:
+	explicit StateStream(int games);
+	~StateStream();
+	StateStream(const StateStream&) = delete;
+	StateStream& operator=(const StateStream&) = delete;
+
+	// Listens on all interfaces; prints the reason and returns false on failure.
+	bool listen(int port);
+
+	int games() const { return games_.size(); }
+
+	// Records one tick of `game`. A new episode is sent as a keyframe.
+	void update(int game, const SpectatorState &state, bool new_episode = false);
+
+	// Appends the ticks recorded since the last flush() to the logs, sends
+	// every spectator what it has not seen yet and serves new subscriptions.
+	void flush();
+
+	int clients() const { return client_count_; }
+	std::uint64_t bytes_sent() const { return bytes_sent_; }
+	// times a lagging spectator skipped ahead to a keyframe
+	std::uint64_t skips() const { return skips_; }
+};//~ StateStream
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads draining one FIFO of tasks. The destructor runs
+// whatever is still queued before joining.
+class ThreadPool final {
+private:
+	std::vector<std::thread> threads_;
+	std::deque<std::function<void()>> tasks_;
+	std::mutex mutex_;
+	std::condition_variable ready_;
+	bool stop_ = false;
+
+	void work() {
+		for (;;) {
+			std::function<void()> task;
+			{
+				std::unique_lock lock(mutex_);
+				ready_.wait(lock, [&] { return stop_ || !tasks_.empty(); });
+				if (tasks_.empty()) {
+					return;
+				}
+				task = std::move(tasks_.front());
+				tasks_.pop_front();
+			}
+			task();
+		}
+	}
+public:
+	explicit ThreadPool(int threads) {
+		threads_.reserve(threads);
+		for (int i = 0; i < threads; ++i) {
+			threads_.emplace_back(&ThreadPool::work, this);
+		}
+	}
+
+	~ThreadPool() {
+		{
+			std::lock_guard lock(mutex_);
+			stop_ = true;
+		}
+		ready_.notify_all();
+		for (auto &t : threads_) {
+			t.join();
+		}
+	}
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	int size() const { return threads_.size(); }
+
+	void submit(std::function<void()> task) {
+		{
+			std::lock_guard lock(mutex_);
+			tasks_.push_back(std::move(task));
+		}
+		ready_.notify_one();
+	}
+};//~ ThreadPool
@@ -0,0 +1,106 @@
+#include "topology.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <dirent.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static bool read_line(const char *path, char *buffer, int size) {
+	std::FILE *f = std::fopen(path, "r");
+	if (!f) {
+		return false;
+	}
+	const bool ok = std::fgets(buffer, size, f) != nullptr;
+	std::fclose(f);
+	return ok;
+}
+
+std::vector<int> parse_cpu_list(const char *text) {
+	std::vector<int> cpus;
+	const char *p = text;
+	while (*p) {
+		char *end;
+		const long first = std::strtol(p, &end, 10);
+		if (end == p) {
+			break;
+		}
+		long last = first;
+		p = end;
+		if (*p == '-') {
+			last = std::strtol(p + 1, &end, 10);
+			p = end;
+		}
+		for (long cpu = first; cpu <= last; ++cpu) {
+			cpus.push_back(static_cast<int>(cpu));
+		}
+		if (*p == ',') {
+			++p;
+		} else {
+			break;
+		}
+	}
+	return cpus;
+}
+
+std::vector<NumaNode> read_numa_topology() {
+	std::vector<NumaNode> nodes;
+	if (DIR *dir = opendir("/sys/devices/system/node")) {
+		while (dirent *entry = readdir(dir)) {
+			int id;
+			char tail;
+			if (std::sscanf(entry->d_name, "node%d%c", &id, &tail) != 1) {
+				continue;
+			}
+			char path[128];
+			char list[4096];
+			std::snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", id);
+			if (read_line(path, list, sizeof(list))) {
+				auto cpus = parse_cpu_list(list);
+				if (!cpus.empty()) {
+					nodes.push_back(NumaNode{id, std::move(cpus)});
+				}
+			}
+		}
+		closedir(dir);
+	}
+
+	if (nodes.empty()) {
+		char list[4096];
+		std::vector<int> cpus;
+		if (read_line("/sys/devices/system/cpu/online", list, sizeof(list))) {
+			cpus = parse_cpu_list(list);
+		}
+		if (cpus.empty()) {
+			for (long cpu = 0; cpu < sysconf(_SC_NPROCESSORS_ONLN); ++cpu) {
+				cpus.push_back(static_cast<int>(cpu));
+			}
+		}
+		nodes.push_back(NumaNode{0, std::move(cpus)});
+	}
+
+	std::sort(nodes.begin(), nodes.end(), [](const NumaNode &a, const NumaNode &b) { return a.id < b.id; });
+	return nodes;
+}
+
+bool pin_current_thread(int cpu) {
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	return sched_setaffinity(0, sizeof(set), &set) == 0;
+}
+
+int node_of_address(const void *addr) {
+#ifdef SYS_get_mempolicy
+	// get_mempolicy(2) without libnuma: MPOL_F_NODE | MPOL_F_ADDR
+	constexpr unsigned long MPOL_F_NODE = 1 << 0;
+	constexpr unsigned long MPOL_F_ADDR = 1 << 1;
+	int node = -1;
+	if (syscall(SYS_get_mempolicy, &node, nullptr, 0, addr, MPOL_F_NODE | MPOL_F_ADDR) == 0) {
+		return node;
+	}
+#endif
+	return -1;
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <vector>
+
+struct NumaNode {
+	int id;
+	std::vector<int> cpus;
+};
+
+// NUMA layout as published in /sys/devices/system/node. Machines without that
+// directory are reported as a single node holding every online CPU.
+std::vector<NumaNode> read_numa_topology();
+
+// Parses a kernel cpu list such as "0-3,8,10-11".
+std::vector<int> parse_cpu_list(const char *text);
+
+// Restricts the calling thread to one CPU; false if the kernel refused.
+bool pin_current_thread(int cpu);
+
+// Node that backs the page at `addr`, or -1 when the kernel cannot tell.
+int node_of_address(const void *addr);
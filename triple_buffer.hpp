@@ -0,0 +1,31 @@
+#pragma once
+
+#include <atomic>
+
+// Single-writer, single-reader handoff of the latest value. The writer fills
+// write_slot() and publishes it without ever waiting; the reader always sees
+// the newest published value and never a half-written one.
+template <typename T>
+class TripleBuffer final {
+private:
+	static constexpr int FRESH = 4;
+
+	T slots_[3] = {};
+	std::atomic<int> middle_{1};
+	int write_ = 0;
+	int read_ = 2;
+public:
+	T &write_slot() { return slots_[write_]; }
+
+	void publish() {
+		write_ = middle_.exchange(write_ | FRESH, std::memory_order_acq_rel) & ~FRESH;
+	}
+
+	// The newest published value; stays valid until the next call.
+	const T &read() {
+		if (middle_.load(std::memory_order_relaxed) & FRESH) {
+			read_ = middle_.exchange(read_, std::memory_order_acq_rel) & ~FRESH;
+		}
+		return slots_[read_];
+	}
+};
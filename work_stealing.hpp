@@ -0,0 +1,83 @@
+#pragma once
+
+#include <algorithm>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Runs f(i) for every i in [0, count) on `threads` threads. Every thread starts
+// with an equal slice of the range and takes indices from its front; a thread
+// that runs dry steals the back half of the fullest slice it can find. Cheap
+// for uneven work, like games that end at score 0 next to games that run to
+// the tick cap, without a queue entry per index.
+template <typename F>
+void parallel_for_stealing(int count, int threads, F &&f) {
+	threads = std::max(1, std::min(threads, count));
+	struct alignas(64) Slice {
+		std::mutex mutex;
+		int begin;
+		int end;
+	};
+	std::vector<Slice> slices(threads);
+	for (int t = 0; t < threads; ++t) {
+		slices[t].begin = static_cast<long>(count) * t / threads;
+		slices[t].end = static_cast<long>(count) * (t + 1) / threads;
+	}
+
+	const auto work = [&](int self) {
+		Slice &own = slices[self];
+		for (;;) {
+			int i = -1;
+			{
+				std::lock_guard lock(own.mutex);
+				if (own.begin < own.end) {
+					i = own.begin++;
+				}
+			}
+			if (i >= 0) {
+				f(i);
+				continue;
+			}
+			// steal from the fullest slice, which may shrink before the
+			// second look under its lock
+			int victim = -1;
+			int most = 1;
+			for (int t = 0; t < threads; ++t) {
+				std::lock_guard lock(slices[t].mutex);
+				if (slices[t].end - slices[t].begin > most) {
+					most = slices[t].end - slices[t].begin;
+					victim = t;
+				}
+			}
+			if (victim < 0) {
+				// at most one index left anywhere, its owner takes it
+				return;
+			}
+			int begin;
+			int end;
+			{
+				std::lock_guard lock(slices[victim].mutex);
+				const int left = slices[victim].end - slices[victim].begin;
+				if (left < 2) {
+					continue;
+				}
+				end = slices[victim].end;
+				begin = end - left / 2;
+				slices[victim].end = begin;
+			}
+			std::lock_guard lock(own.mutex);
+			own.begin = begin;
+			own.end = end;
+		}
+	};
+
+	std::vector<std::thread> workers;
+	workers.reserve(threads - 1);
+	for (int t = 1; t < threads; ++t) {
+		workers.emplace_back(work, t);
+	}
+	work(0);
+	for (auto &w : workers) {
+		w.join();
+	}
+}